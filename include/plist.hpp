@@ -1,15 +1,47 @@
 #ifndef OUZEL_FORMATS_PLIST_HPP
 #define OUZEL_FORMATS_PLIST_HPP
 
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
 #include <chrono>
-#include <map>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <initializer_list>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <optional>
 #include <stdexcept>
 #include <string>
+#include <string_view>
+#include <tuple>
 #include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
 #include <variant>
 #include <vector>
 #include <utility>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#  include <emmintrin.h>
+#  define PLIST_SSE2
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#  include <arm_neon.h>
+#  define PLIST_NEON
+#endif
+
+// libstdc++ before GCC 8 has no <charconv>, the conversions fall back to the C library without it
+#if defined(__has_include)
+#  if __has_include(<charconv>)
+#    include <charconv>
+#  endif
+#endif
+
 namespace plist
 {
     class TypeError final: public std::runtime_error
@@ -24,36 +56,609 @@ namespace plist
         using range_error::range_error;
     };
 
+    class ParseError final: public std::runtime_error
+    {
+    public:
+        using runtime_error::runtime_error;
+    };
+
+    // Data whose bytes stay outside of the tree, e.g. in a memory-mapped file or behind a reader
+    // that streams them from disk. Encoders copy the bytes into the output chunk by chunk.
+    class ExternalData final
+    {
+    public:
+        // must fill the buffer with size bytes starting at offset or throw
+        using Reader = std::function<void(std::size_t offset, std::byte* buffer, std::size_t size)>;
+
+        static constexpr std::size_t chunkSize = 65536;
+
+        // the owner keeps the bytes alive (e.g. unmaps the file when released)
+        ExternalData(const std::byte* d, const std::size_t s, std::shared_ptr<const void> o) noexcept:
+            data{d}, size{s}, owner{std::move(o)}
+        {
+        }
+
+        ExternalData(const std::size_t s, Reader r) noexcept:
+            size{s}, reader{std::move(r)}
+        {
+        }
+
+        [[nodiscard]] std::size_t getSize() const noexcept
+        {
+            return size;
+        }
+
+        // calls the callback with consecutive chunks of at most chunkSize bytes
+        template <typename F>
+        void read(F callback) const
+        {
+            if (reader)
+            {
+                std::vector<std::byte> buffer(std::min(size, chunkSize));
+                for (std::size_t offset = 0; offset < size; offset += buffer.size())
+                {
+                    const auto count = std::min(size - offset, buffer.size());
+                    reader(offset, buffer.data(), count);
+                    callback(static_cast<const std::byte*>(buffer.data()), count);
+                }
+            }
+            else
+                for (std::size_t offset = 0; offset < size; offset += chunkSize)
+                    callback(data + offset, std::min(size - offset, chunkSize));
+        }
+
+        // copies count bytes starting at offset into the buffer
+        void read(const std::size_t offset, std::byte* buffer, const std::size_t count) const
+        {
+            if (offset > size || count > size - offset)
+                throw RangeError{"Index out of range"};
+
+            if (reader)
+                reader(offset, buffer, count);
+            else if (count)
+                std::memcpy(buffer, data + offset, count);
+        }
+
+        [[nodiscard]] bool operator==(const ExternalData& other) const
+        {
+            if (size != other.size) return false;
+            if (!reader && !other.reader && data == other.data) return true;
+
+            std::vector<std::byte> buffer;
+            std::size_t offset = 0;
+            bool result = true;
+            read([&other, &buffer, &offset, &result](const std::byte* bytes, const std::size_t count) {
+                if (!result) return;
+
+                buffer.resize(count);
+                other.read(offset, buffer.data(), count);
+                result = std::memcmp(bytes, buffer.data(), count) == 0;
+                offset += count;
+            });
+            return result;
+        }
+
+    private:
+        const std::byte* data = nullptr;
+        std::size_t size = 0;
+        std::shared_ptr<const void> owner;
+        Reader reader;
+    };
+
+    namespace detail
+    {
+        constexpr std::uint64_t hashPrimes[] = {
+            0xA0761D6478BD642FULL, 0xE7037ED1A0B428DBULL, 0x8EBC6AF09C88C6E3ULL, 0x589965CC75374CC3ULL
+        };
+
+        // 64x64->128 bit multiply folded to 64 bits (the wyhash mixer)
+        [[nodiscard]] inline std::uint64_t mix(const std::uint64_t a, const std::uint64_t b) noexcept
+        {
+#if defined(__SIZEOF_INT128__)
+            const auto product = static_cast<unsigned __int128>(a) * b;
+            return static_cast<std::uint64_t>(product) ^ static_cast<std::uint64_t>(product >> 64);
+#else
+            const auto aLow = a & 0xFFFFFFFFU, aHigh = a >> 32;
+            const auto bLow = b & 0xFFFFFFFFU, bHigh = b >> 32;
+            const auto low = aLow * bLow, middle1 = aHigh * bLow, middle2 = aLow * bHigh, high = aHigh * bHigh;
+            const auto carry = ((low >> 32) + (middle1 & 0xFFFFFFFFU) + (middle2 & 0xFFFFFFFFU)) >> 32;
+            return (low + (middle1 << 32) + (middle2 << 32)) ^ (high + (middle1 >> 32) + (middle2 >> 32) + carry);
+#endif
+        }
+
+        [[nodiscard]] inline std::uint64_t read64(const unsigned char* p, const std::size_t size) noexcept
+        {
+            std::uint64_t result = 0;
+            std::memcpy(&result, p, size);
+            return result;
+        }
+
+        [[nodiscard]] inline std::uint64_t hashBytes(const void* data,
+                                                     const std::size_t size,
+                                                     std::uint64_t seed) noexcept
+        {
+            auto p = static_cast<const unsigned char*>(data);
+            auto remaining = size;
+            seed ^= hashPrimes[0];
+
+            for (; remaining > 16; remaining -= 16, p += 16)
+                seed = mix(read64(p, 8) ^ hashPrimes[1], read64(p + 8, 8) ^ seed);
+
+            const auto a = read64(p, std::min(remaining, std::size_t{8}));
+            const auto b = remaining > 8 ? read64(p + 8, remaining - 8) : 0;
+            return mix(hashPrimes[1] ^ size, mix(a ^ hashPrimes[1], b ^ seed));
+        }
+
+        // Seed of the dictionary indexes. It comes from the address space layout and the start time, so it
+        // differs between processes and documents with colliding keys can not be prepared in advance.
+        [[nodiscard]] inline std::uint64_t getHashSeed() noexcept
+        {
+            static const std::uint64_t seed = mix(reinterpret_cast<std::uintptr_t>(&seed) ^ hashPrimes[2],
+                                                  static_cast<std::uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count()) ^ hashPrimes[3]);
+            return seed;
+        }
+    }
+
+    // Dictionary that keeps its members in insertion order. Each member is allocated separately,
+    // the pointers to them are kept in order and, once there are more than a few, found through
+    // an open-addressing index of their key hashes, so appending is amortized O(1).
+    // Keys must not be modified through iterators. Like with std::map, references to a member stay
+    // valid until it is removed (so v["b"] = v["a"] is safe), but adding or removing a member
+    // invalidates all iterators.
+    template <typename T>
+    class BasicDictionary final
+    {
+        using Node = std::unique_ptr<std::pair<std::string, T>>;
+
+        // a vector iterator that dereferences the nodes
+        template <typename Base, typename Member>
+        class Iterator final
+        {
+        public:
+            using iterator_category = std::random_access_iterator_tag;
+            using value_type = std::pair<std::string, T>;
+            using difference_type = std::ptrdiff_t;
+            using pointer = Member*;
+            using reference = Member&;
+
+            Iterator() noexcept = default;
+            explicit Iterator(const Base b) noexcept: base{b} {}
+
+            // iterator to const_iterator
+            template <typename OtherBase,
+                      typename OtherMember,
+                      typename = std::enable_if_t<std::is_convertible_v<OtherBase, Base>>>
+            Iterator(const Iterator<OtherBase, OtherMember>& other) noexcept: base{other.getBase()} {}
+
+            [[nodiscard]] Base getBase() const noexcept { return base; }
+
+            [[nodiscard]] reference operator*() const noexcept { return **base; }
+            [[nodiscard]] pointer operator->() const noexcept { return base->get(); }
+            [[nodiscard]] reference operator[](const difference_type n) const noexcept { return *base[n]; }
+
+            Iterator& operator++() noexcept { ++base; return *this; }
+            Iterator& operator--() noexcept { --base; return *this; }
+            Iterator operator++(int) noexcept { return Iterator{base++}; }
+            Iterator operator--(int) noexcept { return Iterator{base--}; }
+            Iterator& operator+=(const difference_type n) noexcept { base += n; return *this; }
+            Iterator& operator-=(const difference_type n) noexcept { base -= n; return *this; }
+
+            [[nodiscard]] friend Iterator operator+(const Iterator i, const difference_type n) noexcept { return Iterator{i.base + n}; }
+            [[nodiscard]] friend Iterator operator+(const difference_type n, const Iterator i) noexcept { return Iterator{i.base + n}; }
+            [[nodiscard]] friend Iterator operator-(const Iterator i, const difference_type n) noexcept { return Iterator{i.base - n}; }
+            [[nodiscard]] friend difference_type operator-(const Iterator a, const Iterator b) noexcept { return a.base - b.base; }
+
+            [[nodiscard]] friend bool operator==(const Iterator a, const Iterator b) noexcept { return a.base == b.base; }
+            [[nodiscard]] friend bool operator!=(const Iterator a, const Iterator b) noexcept { return a.base != b.base; }
+            [[nodiscard]] friend bool operator<(const Iterator a, const Iterator b) noexcept { return a.base < b.base; }
+            [[nodiscard]] friend bool operator>(const Iterator a, const Iterator b) noexcept { return a.base > b.base; }
+            [[nodiscard]] friend bool operator<=(const Iterator a, const Iterator b) noexcept { return a.base <= b.base; }
+            [[nodiscard]] friend bool operator>=(const Iterator a, const Iterator b) noexcept { return a.base >= b.base; }
+
+        private:
+            Base base{};
+        };
+
+    public:
+        using key_type = std::string;
+        using mapped_type = T;
+        using value_type = std::pair<std::string, T>;
+        using size_type = std::size_t;
+        using iterator = Iterator<typename std::vector<Node>::iterator, value_type>;
+        using const_iterator = Iterator<typename std::vector<Node>::const_iterator, const value_type>;
+
+        BasicDictionary() noexcept = default;
+
+        BasicDictionary(const BasicDictionary& other):
+            index{other.index}
+        {
+            entries.reserve(other.entries.size());
+            for (const auto& entry : other.entries)
+                entries.push_back(std::make_unique<value_type>(*entry));
+        }
+
+        BasicDictionary(BasicDictionary&& other) noexcept = default;
+
+        BasicDictionary& operator=(const BasicDictionary& other)
+        {
+            if (&other != this) *this = BasicDictionary{other};
+            return *this;
+        }
+
+        BasicDictionary& operator=(BasicDictionary&& other) noexcept = default;
+
+        // like std::map, the first of duplicate keys is kept
+        BasicDictionary(const std::initializer_list<value_type> members)
+        {
+            insert(members.begin(), members.end());
+        }
+
+        template <typename Iterator>
+        BasicDictionary(Iterator first, const Iterator last)
+        {
+            insert(first, last);
+        }
+
+        [[nodiscard]] iterator begin() noexcept { return iterator{entries.begin()}; }
+        [[nodiscard]] iterator end() noexcept { return iterator{entries.end()}; }
+        [[nodiscard]] const_iterator begin() const noexcept { return const_iterator{entries.begin()}; }
+        [[nodiscard]] const_iterator end() const noexcept { return const_iterator{entries.end()}; }
+        [[nodiscard]] const_iterator cbegin() const noexcept { return const_iterator{entries.cbegin()}; }
+        [[nodiscard]] const_iterator cend() const noexcept { return const_iterator{entries.cend()}; }
+
+        [[nodiscard]] bool empty() const noexcept { return entries.empty(); }
+        [[nodiscard]] size_type size() const noexcept { return entries.size(); }
+        [[nodiscard]] size_type capacity() const noexcept { return entries.capacity(); }
+        [[nodiscard]] size_type bucket_count() const noexcept { return index.size(); }
+
+        void reserve(const size_type count)
+        {
+            entries.reserve(count);
+            if (count > linearLimit && index.size() < count * 2) rebuild(count);
+        }
+
+        void clear() noexcept
+        {
+            entries.clear();
+            index.clear();
+        }
+
+        [[nodiscard]] iterator find(const std::string_view key) noexcept
+        {
+            const auto i = locate(key);
+            return i == npos ? end() : begin() + static_cast<std::ptrdiff_t>(i);
+        }
+
+        [[nodiscard]] const_iterator find(const std::string_view key) const noexcept
+        {
+            const auto i = locate(key);
+            return i == npos ? end() : begin() + static_cast<std::ptrdiff_t>(i);
+        }
+
+        [[nodiscard]] size_type count(const std::string_view key) const noexcept
+        {
+            return locate(key) == npos ? 0 : 1;
+        }
+
+        [[nodiscard]] T& at(const std::string_view key)
+        {
+            if (const auto i = locate(key); i != npos) return entries[i]->second;
+            throw std::out_of_range{"Member does not exist"};
+        }
+
+        [[nodiscard]] const T& at(const std::string_view key) const
+        {
+            if (const auto i = locate(key); i != npos) return entries[i]->second;
+            throw std::out_of_range{"Member does not exist"};
+        }
+
+        T& operator[](const std::string_view key)
+        {
+            if (const auto i = locate(key); i != npos) return entries[i]->second;
+            return append(std::string{key})->second;
+        }
+
+        template <typename... Args>
+        std::pair<iterator, bool> try_emplace(std::string key, Args&&... args)
+        {
+            if (const auto i = locate(key); i != npos) return {begin() + static_cast<std::ptrdiff_t>(i), false};
+            return {append(std::move(key), std::forward<Args>(args)...), true};
+        }
+
+        template <typename... Args>
+        std::pair<iterator, bool> emplace(Args&&... args)
+        {
+            return insert(value_type(std::forward<Args>(args)...));
+        }
+
+        std::pair<iterator, bool> insert(const value_type& member)
+        {
+            return try_emplace(member.first, member.second);
+        }
+
+        std::pair<iterator, bool> insert(value_type&& member)
+        {
+            return try_emplace(std::move(member.first), std::move(member.second));
+        }
+
+        // reserves room for the whole range upfront, so the index is sized once;
+        // move iterators move the members in
+        template <typename Iterator>
+        void insert(Iterator first, const Iterator last)
+        {
+            using Category = typename std::iterator_traits<Iterator>::iterator_category;
+            if constexpr (std::is_base_of_v<std::forward_iterator_tag, Category>)
+                reserve(entries.size() + static_cast<size_type>(std::distance(first, last)));
+
+            for (; first != last; ++first) insert(*first);
+        }
+
+        void insert(const std::initializer_list<value_type> members)
+        {
+            insert(members.begin(), members.end());
+        }
+
+        // the hint is ignored, since members are found by hash and always appended at the end;
+        // it is accepted so that code written for std::map compiles
+        template <typename... Args>
+        iterator emplace_hint(const_iterator, Args&&... args)
+        {
+            return emplace(std::forward<Args>(args)...).first;
+        }
+
+        // an existing member keeps its position
+        template <typename M>
+        std::pair<iterator, bool> insert_or_assign(std::string key, M&& value)
+        {
+            if (const auto i = locate(key); i != npos)
+            {
+                entries[i]->second = std::forward<M>(value);
+                return {begin() + static_cast<std::ptrdiff_t>(i), false};
+            }
+            return {append(std::move(key), std::forward<M>(value)), true};
+        }
+
+        // the following members move up to keep their order, so removal is O(n),
+        // their positions in the index are shifted in place
+        iterator erase(const const_iterator position)
+        {
+            const auto i = static_cast<size_type>(position - cbegin());
+            if (!index.empty()) unplace(i);
+            entries.erase(position.getBase());
+
+            if (entries.size() <= linearLimit)
+                index.clear();
+            else
+                for (auto& slot : index)
+                    if ((slot & 0xFFFFFFFFU) > i + 1) --slot;
+
+            return begin() + static_cast<std::ptrdiff_t>(i);
+        }
+
+        size_type erase(const std::string_view key)
+        {
+            const auto i = locate(key);
+            if (i == npos) return 0;
+            erase(cbegin() + static_cast<std::ptrdiff_t>(i));
+            return 1;
+        }
+
+        // reorders the members by key
+        void sort()
+        {
+            std::sort(entries.begin(), entries.end(), [](const Node& a, const Node& b) {
+                return a->first < b->first;
+            });
+            rebuild(entries.size());
+        }
+
+        // the same members in any order
+        [[nodiscard]] bool operator==(const BasicDictionary& other) const
+        {
+            if (entries.size() != other.entries.size()) return false;
+
+            for (const auto& [key, value] : *this)
+            {
+                const auto i = other.locate(key);
+                if (i == npos || !(other.entries[i]->second == value)) return false;
+            }
+            return true;
+        }
+
+        [[nodiscard]] bool operator!=(const BasicDictionary& other) const
+        {
+            return !(*this == other);
+        }
+
+    private:
+        static constexpr size_type npos = std::numeric_limits<size_type>::max();
+        static constexpr size_type linearLimit = 8; // smaller dictionaries are searched without an index
+
+        [[nodiscard]] static std::uint64_t hashKey(const std::string_view key) noexcept
+        {
+            return detail::hashBytes(key.data(), key.size(), detail::getHashSeed());
+        }
+
+        [[nodiscard]] size_type locate(const std::string_view key) const noexcept
+        {
+            if (index.empty())
+            {
+                for (size_type i = 0; i < entries.size(); ++i)
+                    if (entries[i]->first == key) return i;
+                return npos;
+            }
+
+            // a slot holds the upper half of the hash and the entry index + 1, or zero if it is empty
+            const auto hash = hashKey(key);
+            const auto mask = index.size() - 1;
+            for (auto slot = static_cast<size_type>(hash) & mask;; slot = (slot + 1) & mask)
+            {
+                const auto value = index[slot];
+                if (!value) return npos;
+                if ((value >> 32) == (hash >> 32))
+                {
+                    const auto i = static_cast<size_type>(value & 0xFFFFFFFFU) - 1;
+                    if (entries[i]->first == key) return i;
+                }
+            }
+        }
+
+        void place(const size_type i)
+        {
+            const auto hash = hashKey(entries[i]->first);
+            const auto mask = index.size() - 1;
+            auto slot = static_cast<size_type>(hash) & mask;
+            while (index[slot]) slot = (slot + 1) & mask;
+            index[slot] = (hash & 0xFFFFFFFF00000000ULL) | (static_cast<std::uint64_t>(i) + 1);
+        }
+
+        // removes the slot of the entry, moving the rest of its cluster back so that no probe sequence is broken
+        void unplace(const size_type i) noexcept
+        {
+            const auto mask = index.size() - 1;
+            auto slot = static_cast<size_type>(hashKey(entries[i]->first)) & mask;
+            while ((index[slot] & 0xFFFFFFFFU) != i + 1) slot = (slot + 1) & mask;
+
+            for (auto next = (slot + 1) & mask; index[next]; next = (next + 1) & mask)
+            {
+                const auto& key = entries[static_cast<size_type>(index[next] & 0xFFFFFFFFU) - 1]->first;
+                const auto home = static_cast<size_type>(hashKey(key)) & mask;
+                if (((next - home) & mask) >= ((next - slot) & mask))
+                {
+                    index[slot] = index[next];
+                    slot = next;
+                }
+            }
+            index[slot] = 0;
+        }
+
+        // indexes at least count members, or drops the index of small dictionaries
+        void rebuild(const size_type count)
+        {
+            if (count <= linearLimit)
+            {
+                index.clear();
+                return;
+            }
+            if (count >= 0xFFFFFFFFU) throw std::length_error{"Too many members"};
+
+            size_type slots = 32;
+            while (slots < count * 2) slots *= 2;
+            index.assign(slots, 0);
+            for (size_type i = 0; i < entries.size(); ++i) place(i);
+        }
+
+        template <typename... Args>
+        iterator append(std::string key, Args&&... args)
+        {
+            entries.push_back(std::make_unique<value_type>(std::piecewise_construct,
+                                                           std::forward_as_tuple(std::move(key)),
+                                                           std::forward_as_tuple(std::forward<Args>(args)...)));
+
+            // at most half of the slots are used
+            if (index.size() < entries.size() * 2)
+                rebuild(std::max(entries.size(), index.size()));
+            else
+                place(entries.size() - 1);
+
+            return std::prev(end());
+        }
+
+        std::vector<Node> entries;
+        std::vector<std::uint64_t> index; // empty for small dictionaries, otherwise a power of two
+    };
+
+    enum class Type
+    {
+        dictionary,
+        array,
+        string,
+        real,
+        integer,
+        boolean,
+        data, // external data too
+        date
+    };
+
+    // Dictionaries and arrays are reference-counted and shared between copies of a Value,
+    // so copying is O(1) and a copy, once made, can be handed to another thread and used there
+    // while the original is modified. As with standard containers, a Value itself must not be
+    // copied or read while another thread modifies it. A container is cloned
+    // on the first mutable access (non-const as, begin, end, operator[], resize, pushBack)
+    // while it is still shared, so references obtained through a mutable access must not be
+    // written to after the Value has been copied.
     class Value final
     {
-        using Dictionary = std::map<std::string, Value>;
+        using Dictionary = BasicDictionary<Value>;
         using Array = std::vector<Value>;
         using Data = std::vector<std::byte>;
         using String = std::string;
         using Date = std::chrono::system_clock::time_point;
+
+        template <typename T>
+        class Shared final
+        {
+        public:
+            Shared() noexcept = default;
+            explicit Shared(const T& v): pointer{std::make_shared<T>(v)} {}
+            explicit Shared(T&& v): pointer{std::make_shared<T>(std::move(v))} {}
+
+            [[nodiscard]] const T& get() const noexcept
+            {
+                static const T empty{};
+                return pointer ? *pointer : empty;
+            }
+
+            [[nodiscard]] T& mutate()
+            {
+                if (!pointer)
+                    pointer = std::make_shared<T>();
+                else if (pointer.use_count() > 1)
+                    pointer = std::make_shared<T>(*pointer);
+                else // pairs with the release of the other owners, so their reads finish before the writes
+                    std::atomic_thread_fence(std::memory_order_acquire);
+
+                return *pointer;
+            }
+
+            [[nodiscard]] bool operator==(const Shared& other) const
+            {
+                return pointer == other.pointer || get() == other.get();
+            }
+
+        private:
+            // null until the first mutation, so that default-constructed values do not allocate
+            std::shared_ptr<T> pointer;
+        };
+
     public:
-        Value() noexcept(false) {}
-        Value(const Dictionary& v) noexcept(false): value{v} {}
-        Value(const Array& v) noexcept(false): value(v) {}
+        Value() noexcept {}
+        Value(const Dictionary& v) noexcept(false): value{Shared<Dictionary>{v}} {}
+        Value(Dictionary&& v) noexcept(false): value{Shared<Dictionary>{std::move(v)}} {}
+        Value(const Array& v) noexcept(false): value{Shared<Array>{v}} {}
+        Value(Array&& v) noexcept(false): value{Shared<Array>{std::move(v)}} {}
         Value(const bool v) noexcept: value{v} {}
         template <typename T, typename std::enable_if_t<std::is_floating_point_v<T>>* = nullptr>
         Value(const T v) noexcept: value{static_cast<double>(v)} {}
         template <typename T, typename std::enable_if_t<std::is_integral_v<T> && !std::is_same_v<T, bool>>* = nullptr>
         Value(const T v) noexcept: value{static_cast<std::int64_t>(v)} {}
         Value(const String& v) noexcept(false): value{v} {}
+        Value(String&& v) noexcept(false): value{std::move(v)} {}
         Value(const char* v) noexcept(false): value{std::in_place_type_t<std::string>{}, v} {}
         Value(const Data& v) noexcept(false): value{v} {}
+        Value(Data&& v) noexcept(false): value{std::move(v)} {}
         Value(const Date& v) noexcept(false): value{v} {}
+        Value(const ExternalData& v) noexcept(false): value{v} {}
 
         Value& operator=(const Dictionary& v) noexcept(false)
         {
-            value = v;
+            value = Shared<Dictionary>{v};
             return *this;
         }
 
         Value& operator=(const Array& v) noexcept(false)
         {
-            value = v;
+            value = Shared<Array>{v};
             return *this;
         }
 
@@ -95,6 +700,12 @@ namespace plist
             return *this;
         }
 
+        Value& operator=(const ExternalData& v) noexcept(false)
+        {
+            value = v;
+            return *this;
+        }
+
         template <typename T, typename std::enable_if_t<std::is_same_v<T, bool>>* = nullptr>
         [[nodiscard]] bool is() const noexcept
         {
@@ -125,13 +736,13 @@ namespace plist
         template <typename T, typename std::enable_if_t<std::is_same_v<T, Dictionary>>* = nullptr>
         [[nodiscard]] bool is() const noexcept
         {
-            return std::holds_alternative<Dictionary>(value);
+            return std::holds_alternative<Shared<Dictionary>>(value);
         }
 
         template <typename T, typename std::enable_if_t<std::is_same_v<T, Array>>* = nullptr>
         [[nodiscard]] bool is() const noexcept
         {
-            return std::holds_alternative<Array>(value);
+            return std::holds_alternative<Shared<Array>>(value);
         }
 
         template <typename T, typename std::enable_if_t<std::is_same_v<T, Data>>* = nullptr>
@@ -146,6 +757,12 @@ namespace plist
             return std::holds_alternative<Date>(value);
         }
 
+        template <typename T, typename std::enable_if_t<std::is_same_v<T, ExternalData>>* = nullptr>
+        [[nodiscard]] bool is() const noexcept
+        {
+            return std::holds_alternative<ExternalData>(value);
+        }
+
         template <typename T, typename std::enable_if_t<std::is_same_v<T, bool>>* = nullptr>
         [[nodiscard]] T as() const
         {
@@ -180,11 +797,12 @@ namespace plist
             std::is_same_v<T, Dictionary> ||
             std::is_same_v<T, Array> ||
             std::is_same_v<T, Data> ||
-            std::is_same_v<T, Date>
+            std::is_same_v<T, Date> ||
+            std::is_same_v<T, ExternalData>
         >* = nullptr>
         [[nodiscard]] T& as()
         {
-            if (const auto p = std::get_if<T>(&value))
+            if (const auto p = getMutableIf<T>())
                 return *p;
             else
                 throw TypeError{"Wrong type"};
@@ -204,11 +822,12 @@ namespace plist
             std::is_same_v<T, Dictionary> ||
             std::is_same_v<T, Array> ||
             std::is_same_v<T, Data> ||
-            std::is_same_v<T, Date>
+            std::is_same_v<T, Date> ||
+            std::is_same_v<T, ExternalData>
         >* = nullptr>
         [[nodiscard]] const T& as() const
         {
-            if (const auto p = std::get_if<T>(&value))
+            if (const auto p = getIf<T>())
                 return *p;
             else
                 throw TypeError{"Wrong type"};
@@ -216,7 +835,7 @@ namespace plist
 
         [[nodiscard]] auto begin()
         {
-            if (const auto p = std::get_if<Array>(&value))
+            if (const auto p = getMutableIf<Array>())
                 return p->begin();
             else
                 throw TypeError{"Wrong type"};
@@ -224,7 +843,7 @@ namespace plist
 
         [[nodiscard]] auto end()
         {
-            if (const auto p = std::get_if<Array>(&value))
+            if (const auto p = getMutableIf<Array>())
                 return p->end();
             else
                 throw TypeError{"Wrong type"};
@@ -232,7 +851,7 @@ namespace plist
 
         [[nodiscard]] auto begin() const
         {
-            if (const auto p = std::get_if<Array>(&value))
+            if (const auto p = getIf<Array>())
                 return p->begin();
             else
                 throw TypeError{"Wrong type"};
@@ -240,7 +859,7 @@ namespace plist
 
         [[nodiscard]] auto end() const
         {
-            if (const auto p = std::get_if<Array>(&value))
+            if (const auto p = getIf<Array>())
                 return p->end();
             else
                 throw TypeError{"Wrong type"};
@@ -248,7 +867,7 @@ namespace plist
 
         [[nodiscard]] auto hasMember(const std::string& member) const
         {
-            if (const auto p = std::get_if<Dictionary>(&value))
+            if (const auto p = getIf<Dictionary>())
                 return p->find(member) != p->end();
             else
                 throw TypeError{"Wrong type"};
@@ -256,16 +875,9 @@ namespace plist
 
         [[nodiscard]] Value& operator[](const std::string& member) &
         {
-            if (const auto p = std::get_if<Dictionary>(&value))
+            if (const auto p = getMutableIf<Dictionary>())
             {
-                if (const auto iterator = p->find(member); iterator != p->end())
-                    return iterator->second;
-                else
-                {
-                    const auto [newIterator, success] = p->try_emplace({std::string{member}});
-                    (void)success;
-                    return newIterator->second;
-                }
+                return (*p)[member];
             }
             else
                 throw TypeError{"Wrong type"};
@@ -273,7 +885,7 @@ namespace plist
 
         [[nodiscard]] const Value& operator[](const std::string& member) const&
         {
-            if (const auto p = std::get_if<Dictionary>(&value))
+            if (const auto p = getIf<Dictionary>())
             {
                 if (const auto iterator = p->find(member); iterator != p->end())
                     return iterator->second;
@@ -286,7 +898,7 @@ namespace plist
 
         [[nodiscard]] Value& operator[](const std::size_t index) &
         {
-            if (const auto p = std::get_if<Array>(&value))
+            if (const auto p = getMutableIf<Array>())
             {
                 if (index >= p->size()) p->resize(index + 1);
                 return (*p)[index];
@@ -297,7 +909,7 @@ namespace plist
 
         [[nodiscard]] const Value& operator[](const std::size_t index) const&
         {
-            if (const auto p = std::get_if<Array>(&value))
+            if (const auto p = getIf<Array>())
             {
                 if (index < p->size())
                     return (*p)[index];
@@ -310,15 +922,25 @@ namespace plist
 
         [[nodiscard]] bool isEmpty() const
         {
-            if (const auto p = std::get_if<Array>(&value))
+            if (const auto p = getIf<Array>())
                 return p->empty();
             else
                 throw TypeError{"Wrong type"};
         }
 
+        [[nodiscard]] Type getType() const noexcept
+        {
+            // in the order of the variant alternatives
+            constexpr Type types[] = {
+                Type::dictionary, Type::array, Type::string, Type::real, Type::integer,
+                Type::boolean, Type::data, Type::date, Type::data
+            };
+            return types[value.index()];
+        }
+
         [[nodiscard]] std::size_t getSize() const
         {
-            if (const auto p = std::get_if<Array>(&value))
+            if (const auto p = getIf<Array>())
                 return p->size();
             else
                 throw TypeError{"Wrong type"};
@@ -326,7 +948,7 @@ namespace plist
 
         void resize(const std::size_t size) &
         {
-            if (const auto p = std::get_if<Array>(&value))
+            if (const auto p = getMutableIf<Array>())
                 return p->resize(size);
             else
                 throw TypeError{"Wrong type"};
@@ -334,7 +956,7 @@ namespace plist
 
         void pushBack(const Value& v) &
         {
-            if (const auto p = std::get_if<Array>(&value))
+            if (const auto p = getMutableIf<Array>())
                 return p->push_back(v);
             else
                 throw TypeError{"Wrong type"};
@@ -348,302 +970,3513 @@ namespace plist
                 throw TypeError{"Wrong type"};
         }
 
-        auto& getValue() const noexcept { return value; }
-
-    private:
-        std::variant<Dictionary, Array, String, double, std::int64_t, bool, Data, Date> value{};
-    };
+        [[nodiscard]] bool operator==(const Value& other) const
+        {
+            // variant, map and vector comparisons check the type and size first
+            return this == &other || value == other.value;
+        }
 
-    enum class Format
-    {
-        text,
-        xml
-    };
+        [[nodiscard]] bool operator!=(const Value& other) const
+        {
+            return !(*this == other);
+        }
 
-    using Dictionary = std::map<std::string, Value>;
-    using Array = std::vector<Value>;
+        template <typename T>
+        [[nodiscard]] const T* getIf() const noexcept
+        {
+            if constexpr (std::is_same_v<T, Dictionary> || std::is_same_v<T, Array>)
+            {
+                if (const auto p = std::get_if<Shared<T>>(&value))
+                    return &p->get();
+                else
+                    return nullptr;
+            }
+            else
+                return std::get_if<T>(&value);
+        }
+
+    private:
+        template <typename T>
+        [[nodiscard]] T* getMutableIf()
+        {
+            if constexpr (std::is_same_v<T, Dictionary> || std::is_same_v<T, Array>)
+            {
+                if (const auto p = std::get_if<Shared<T>>(&value))
+                    return &p->mutate();
+                else
+                    return nullptr;
+            }
+            else
+                return std::get_if<T>(&value);
+        }
+
+        std::variant<Shared<Dictionary>, Shared<Array>, String, double, std::int64_t, bool, Data, Date, ExternalData> value{};
+    };
+
+    enum class Format
+    {
+        text,
+        xml,
+        binary,
+        json // data is written as base64 strings and dates as ISO 8601 strings
+    };
+
+    enum class Uniquing
+    {
+        none, // every object is written separately
+        leaves, // equal strings, numbers, data and dates are written once
+        all // equal arrays and dictionaries are written once too
+    };
+
+    enum class KeyOrder
+    {
+        insertion, // the members of dictionaries are written in the order in which they were inserted
+        sorted // by key, without reordering the dictionaries themselves
+    };
+
+    struct Options final
+    {
+        bool whiteSpaces = false; // selects PrettyStyle or CompactStyle
+        Uniquing uniquing = Uniquing::all;
+        bool escapeNonAscii = false; // write non-ASCII characters of text strings as \U escapes
+        KeyOrder keyOrder = KeyOrder::insertion;
+    };
+
+    enum class LineEnding
+    {
+        lf,
+        crlf
+    };
+
+    // Formatting of the text, XML and JSON formats. It is a compile-time parameter of the encoders,
+    // so that every configuration is instantiated without branches on it.
+    template <bool isPretty,
+              char indentCharacter = '\t',
+              std::size_t indentWidth = 1,
+              LineEnding lineEnding = LineEnding::lf>
+    struct Style final
+    {
+        static constexpr bool pretty = isPretty;
+
+        // ends the line also in compact output, where a line comment needs it
+        static void endLine(std::string& result)
+        {
+            if constexpr (lineEnding == LineEnding::crlf)
+                result += "\r\n";
+            else
+                result.push_back('\n');
+        }
+
+        static void newLine(std::string& result)
+        {
+            if constexpr (pretty) endLine(result);
+        }
+
+        static void indent(const std::size_t level, std::string& result)
+        {
+            if constexpr (pretty)
+                result.append(level * indentWidth, indentCharacter);
+        }
+    };
+
+    using CompactStyle = Style<false>;
+    using PrettyStyle = Style<true>;
+
+    using Dictionary = BasicDictionary<Value>;
+    using Array = std::vector<Value>;
     using Data = std::vector<std::byte>;
     using String = std::string;
     using Date = std::chrono::system_clock::time_point;
 
-    [[nodiscard]]
-    inline std::string encode(const Value& value,
-                              const Format format,
-                              const bool whiteSpaces = false)
+    namespace detail
     {
-        class TextEncoder final
+        constexpr char base64Chars[] = {
+            'A', 'B', 'C', 'D', 'E', 'F', 'G', 'H', 'I', 'J', 'K', 'L', 'M',
+            'N', 'O', 'P', 'Q', 'R', 'S', 'T', 'U', 'V', 'W', 'X', 'Y', 'Z',
+            'a', 'b', 'c', 'd', 'e', 'f', 'g', 'h', 'i', 'j', 'k', 'l', 'm',
+            'n', 'o', 'p', 'q', 'r', 's', 't', 'u', 'v', 'w', 'x', 'y', 'z',
+            '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', '+', '/'
+        };
+
+        // length of the leading run of ASCII characters, checked 16 bytes at a time where SIMD is available
+        [[nodiscard]] inline std::size_t countAscii(const char* data, const std::size_t size) noexcept
         {
-        public:
-            [[nodiscard]]
-            static std::string encode(const Value& value, const bool whiteSpaces)
+            std::size_t i = 0;
+#if defined(PLIST_SSE2)
+            for (; i + 16 <= size; i += 16)
+                if (_mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i)))) break;
+#elif defined(PLIST_NEON)
+            for (; i + 16 <= size; i += 16)
+                if (vmaxvq_u8(vld1q_u8(reinterpret_cast<const std::uint8_t*>(data + i))) >= 0x80) break;
+#endif
+            for (; i + 8 <= size; i += 8)
             {
-                std::string result = "// !$*UTF8*$!\n";
-                encode(value, result, whiteSpaces);
-                return result;
+                std::uint64_t word;
+                std::memcpy(&word, data + i, sizeof(word));
+                if (word & 0x8080808080808080ULL) break;
             }
+            while (i < size && static_cast<unsigned char>(data[i]) < 0x80) ++i;
+            return i;
+        }
 
-        private:
-            static void encode(const std::string& s, std::string& result)
-            {
-                if (!s.empty())
-                {
-                    bool hasSpecialChars = false;
-                    for (const auto c : s)
-                        if ((c < 'a' || c > 'z') &&
-                            (c < 'A' || c > 'Z') &&
-                            (c < '0' || c > '9') &&
-                            c != '_' && c != '$' && c != '/' &&
-                            c != ':' && c != '.' && c != '-')
-                        {
-                            hasSpecialChars = true;
-                            break;
-                        }
+        // decodes one code point, rejecting overlong forms, surrogates and values above U+10FFFF
+        [[nodiscard]] inline bool decodeUtf8(const char* data,
+                                             const std::size_t size,
+                                             std::size_t& i,
+                                             char32_t& codePoint) noexcept
+        {
+            const auto c = static_cast<unsigned char>(data[i]);
+            std::size_t length;
+            unsigned char lower = 0x80;
+            unsigned char upper = 0xBF;
 
-                    if (hasSpecialChars) result.push_back('"');
-                    for (const auto c : s)
-                    {
-                        if (c == '"' || c == '\\') result += '\\';
-                        result += c;
-                    }
-                    if (hasSpecialChars) result.push_back('"');
-                }
-                else
-                    result += "\"\"";
+            if (c < 0x80)
+            {
+                codePoint = c;
+                ++i;
+                return true;
+            }
+            else if (c < 0xC2)
+                return false;
+            else if (c < 0xE0)
+            {
+                length = 2;
+                codePoint = c & 0x1F;
+            }
+            else if (c < 0xF0)
+            {
+                length = 3;
+                codePoint = c & 0x0F;
+                if (c == 0xE0) lower = 0xA0;
+                else if (c == 0xED) upper = 0x9F;
             }
+            else if (c < 0xF5)
+            {
+                length = 4;
+                codePoint = c & 0x07;
+                if (c == 0xF0) lower = 0x90;
+                else if (c == 0xF4) upper = 0x8F;
+            }
+            else
+                return false;
+
+            if (size - i < length) return false;
 
-            static void encode(const Dictionary& dictionary,
-                               const bool whiteSpaces,
-                               const std::size_t level,
-                               std::string& result)
+            for (std::size_t j = 1; j < length; ++j)
             {
-                result.push_back('{');
-                for (const auto& [key, entryValue] : dictionary)
-                {
-                    if (whiteSpaces) result.push_back('\n');
-                    if (whiteSpaces) result.insert(result.end(), level + 1, '\t');
-                    encode(key, result);
-                    if (whiteSpaces) result.push_back(' ');
-                    result.push_back('=');
-                    if (whiteSpaces) result.push_back(' ');
-                    encode(entryValue, result, whiteSpaces, level + 1);
-                    result.push_back(';'); // trailing semicolon is mandatory
-                }
-                if (whiteSpaces) result.push_back('\n');
-                if (whiteSpaces) result.insert(result.end(), level, '\t');
-                result += "}";
+                const auto continuation = static_cast<unsigned char>(data[i + j]);
+                if (continuation < lower || continuation > upper) return false;
+                lower = 0x80;
+                upper = 0xBF;
+                codePoint = (codePoint << 6) | (continuation & 0x3F);
             }
 
-            static void encode(const Array& array,
-                               const bool whiteSpaces,
-                               const std::size_t level,
-                               std::string& result)
+            i += length;
+            return true;
+        }
+
+        struct Utf8Info final
+        {
+            bool valid = true;
+            bool ascii = true;
+            std::size_t utf16Length = 0;
+        };
+
+        [[nodiscard]] inline Utf8Info inspectUtf8(const char* data, const std::size_t size) noexcept
+        {
+            Utf8Info result;
+            std::size_t i = 0;
+
+            for (;;)
             {
-                result.push_back('(');
-                std::size_t count = 0;
-                for (const auto& child : array)
+                const auto ascii = countAscii(data + i, size - i);
+                i += ascii;
+                result.utf16Length += ascii;
+                if (i == size) return result;
+
+                result.ascii = false;
+                char32_t codePoint;
+                if (!decodeUtf8(data, size, i, codePoint))
                 {
-                    if (count++) result.push_back(','); // trailing comma is optional
-                    if (whiteSpaces) result.push_back('\n');
-                    if (whiteSpaces) result.insert(result.end(), level + 1, '\t');
-                    encode(child, result, whiteSpaces, level + 1);
+                    result.valid = false;
+                    return result;
                 }
-                if (whiteSpaces) result.push_back('\n');
-                if (whiteSpaces) result.insert(result.end(), level, '\t');
-                result += ')';
+                result.utf16Length += codePoint >= 0x10000 ? 2 : 1;
             }
+        }
 
-            static void encode(const Data& data,
-                               const bool whiteSpaces,
-                               std::string& result)
+        // appends valid UTF-8 as UTF-16BE, ASCII runs are widened 16 characters at a time where SIMD is available
+        inline void appendUtf16BigEndian(const char* data, const std::size_t size, std::string& result)
+        {
+            for (std::size_t i = 0; i < size;)
             {
-                result += '<';
-                std::size_t count = 0;
-                for (const auto b : data)
+                const auto ascii = countAscii(data + i, size - i);
+                auto output = result.size();
+                result.resize(output + ascii * 2);
+
+                std::size_t j = 0;
+#if defined(PLIST_SSE2)
+                const auto zero = _mm_setzero_si128();
+                for (; j + 16 <= ascii; j += 16, output += 32)
                 {
-                    if (whiteSpaces && count++) result.push_back(' ');
-                    constexpr char digits[] = "0123456789ABCDEF";
-                    result += digits[(static_cast<std::size_t>(b) >> 4) & 0x0F];
-                    result += digits[static_cast<std::size_t>(b) & 0x0F];
+                    const auto chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + j));
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(&result[output]), _mm_unpacklo_epi8(zero, chunk));
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(&result[output + 16]), _mm_unpackhi_epi8(zero, chunk));
                 }
-                result += '>';
+#elif defined(PLIST_NEON)
+                for (; j + 16 <= ascii; j += 16, output += 32)
+                {
+                    const uint8x16x2_t widened{{vdupq_n_u8(0), vld1q_u8(reinterpret_cast<const std::uint8_t*>(data + i + j))}};
+                    vst2q_u8(reinterpret_cast<std::uint8_t*>(&result[output]), widened);
+                }
+#endif
+                for (; j < ascii; ++j, output += 2)
+                {
+                    result[output] = '\0';
+                    result[output + 1] = data[i + j];
+                }
+
+                i += ascii;
+                if (i == size) break;
+
+                char32_t codePoint;
+                if (!decodeUtf8(data, size, i, codePoint))
+                    throw std::runtime_error{"Invalid UTF-8"};
+
+                const auto appendUnit = [&result](const char32_t unit) {
+                    result.push_back(static_cast<char>((unit >> 8) & 0xFF));
+                    result.push_back(static_cast<char>(unit & 0xFF));
+                };
+
+                if (codePoint >= 0x10000)
+                {
+                    appendUnit(0xD800 + ((codePoint - 0x10000) >> 10));
+                    appendUnit(0xDC00 + ((codePoint - 0x10000) & 0x3FF));
+                }
+                else
+                    appendUnit(codePoint);
             }
+        }
 
-            static void encode(const Value& value,
-                               std::string& result,
-                               const bool whiteSpaces,
-                               const std::size_t level = 0)
+        // length of the leading run of characters that JSON strings hold unescaped
+        // (no control characters, quotes or backslashes), checked 16 bytes at a time where SIMD is available
+        [[nodiscard]] inline std::size_t countJsonPlain(const char* data, const std::size_t size) noexcept
+        {
+            std::size_t i = 0;
+#if defined(PLIST_SSE2)
+            const auto space = _mm_set1_epi8(0x20);
+            const auto quote = _mm_set1_epi8('"');
+            const auto backslash = _mm_set1_epi8('\\');
+            for (; i + 16 <= size; i += 16)
             {
-                if (auto dictionary = std::get_if<Dictionary>(&value.getValue()))
-                    encode(*dictionary, whiteSpaces, level, result);
-                else if (auto array = std::get_if<Array>(&value.getValue()))
-                    encode(*array, whiteSpaces, level, result);
-                else if (auto string = std::get_if<String>(&value.getValue()))
-                    encode(*string, result);
-                else if (auto real = std::get_if<double>(&value.getValue()))
-                    result += std::to_string(*real);
-                else if (auto integer = std::get_if<std::int64_t>(&value.getValue()))
-                    result += std::to_string(*integer);
-                else if (auto boolean = std::get_if<bool>(&value.getValue()))
-                    result += *boolean ? "YES" : "NO";
-                else if (auto data = std::get_if<Data>(&value.getValue()))
-                    encode(*data, whiteSpaces, result);
-                else if (std::get_if<Date>(&value.getValue()))
-                    throw std::runtime_error{"Date fields are not supported"};
-                else
-                    throw std::runtime_error{"Unsupported format"};
+                const auto chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+                const auto control = _mm_andnot_si128(_mm_cmpeq_epi8(_mm_max_epu8(chunk, space), chunk), _mm_set1_epi8(-1));
+                const auto special = _mm_or_si128(control, _mm_or_si128(_mm_cmpeq_epi8(chunk, quote),
+                                                                         _mm_cmpeq_epi8(chunk, backslash)));
+                if (_mm_movemask_epi8(special)) break;
             }
-        };
+#elif defined(PLIST_NEON)
+            const auto space = vdupq_n_u8(0x20);
+            const auto quote = vdupq_n_u8('"');
+            const auto backslash = vdupq_n_u8('\\');
+            for (; i + 16 <= size; i += 16)
+            {
+                const auto chunk = vld1q_u8(reinterpret_cast<const std::uint8_t*>(data + i));
+                const auto special = vorrq_u8(vcltq_u8(chunk, space), vorrq_u8(vceqq_u8(chunk, quote),
+                                                                              vceqq_u8(chunk, backslash)));
+                if (vmaxvq_u8(special)) break;
+            }
+#endif
+            constexpr std::uint64_t ones = 0x0101010101010101ULL;
+            constexpr std::uint64_t highBits = 0x8080808080808080ULL;
+            for (; i + 8 <= size; i += 8)
+            {
+                std::uint64_t word;
+                std::memcpy(&word, data + i, sizeof(word));
+                const auto quotes = word ^ (ones * '"');
+                const auto backslashes = word ^ (ones * '\\');
+                // bytes below 0x20, and bytes equal to zero after the xor
+                if ((((word - ones * 0x20) & ~word) |
+                     ((quotes - ones) & ~quotes) |
+                     ((backslashes - ones) & ~backslashes)) & highBits) break;
+            }
+            for (; i < size; ++i)
+            {
+                const auto c = static_cast<unsigned char>(data[i]);
+                if (c < 0x20 || c == '"' || c == '\\') break;
+            }
+            return i;
+        }
 
-        class XmlEncoder final
+        [[nodiscard]] inline std::uint64_t hashInteger(const std::uint64_t value, const std::uint64_t seed) noexcept
         {
-        public:
-            [[nodiscard]]
-            static std::string encode(const Value& value, const bool whiteSpaces)
+            return mix(value ^ hashPrimes[2], seed ^ hashPrimes[3]);
+        }
+    }
+
+    namespace detail
+    {
+        // hashes the value, the members and elements are hashed by childHash(child, seed)
+        template <typename F>
+        std::uint64_t hashValue(const Value& value, const std::uint64_t seed, F&& childHash)
+        {
+            const auto typeSeed = hashInteger(static_cast<std::uint64_t>(value.getType()), seed);
+
+            if (const auto dictionary = value.getIf<Dictionary>())
             {
-                std::string result = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>";
-                if (whiteSpaces) result.push_back('\n');
-                result += "<!DOCTYPE plist PUBLIC \"-//Apple//DTD PLIST 1.0//EN\" \"http://www.apple.com/DTDs/PropertyList-1.0.dtd\">";
-                if (whiteSpaces) result.push_back('\n');
-                result += "<plist version=\"1.0\">";
-                if (whiteSpaces) result.push_back('\n');
-                encode(value, result, whiteSpaces);
-                if (whiteSpaces) result.push_back('\n');
-                result += "</plist>";
+                // the members are summed, because equal dictionaries can have different orders
+                std::uint64_t sum = 0;
+                for (const auto& [key, entryValue] : *dictionary)
+                    sum += mix(hashBytes(key.data(), key.size(), typeSeed),
+                               childHash(entryValue, typeSeed) ^ hashPrimes[1]);
+                return mix(hashInteger(dictionary->size(), typeSeed), sum ^ hashPrimes[2]);
+            }
+            else if (const auto array = value.getIf<Array>())
+            {
+                auto result = hashInteger(array->size(), typeSeed);
+                for (const auto& child : *array)
+                    result = mix(result ^ hashPrimes[0], childHash(child, typeSeed) ^ hashPrimes[1]);
+                return result;
+            }
+            else if (const auto string = value.getIf<String>())
+                return hashBytes(string->data(), string->size(), typeSeed);
+            else if (const auto real = value.getIf<double>())
+            {
+                // 0.0 and -0.0 compare equal, so they must hash equally
+                const auto normalized = *real == 0.0 ? 0.0 : *real;
+                std::uint64_t bits;
+                std::memcpy(&bits, &normalized, sizeof(bits));
+                return hashInteger(bits, typeSeed);
+            }
+            else if (const auto integer = value.getIf<std::int64_t>())
+                return hashInteger(static_cast<std::uint64_t>(*integer), typeSeed);
+            else if (const auto boolean = value.getIf<bool>())
+                return hashInteger(*boolean ? 1U : 0U, typeSeed);
+            else if (const auto data = value.getIf<Data>())
+                return hashBytes(data->data(), data->size(), typeSeed);
+            else if (const auto date = value.getIf<Date>())
+                return hashInteger(static_cast<std::uint64_t>(date->time_since_epoch().count()), typeSeed);
+            else if (const auto externalData = value.getIf<ExternalData>())
+            {
+                auto result = hashInteger(externalData->getSize(), typeSeed);
+                externalData->read([&result](const std::byte* bytes, const std::size_t size) {
+                    result = hashBytes(bytes, size, result);
+                });
                 return result;
             }
+            else
+                throw std::runtime_error{"Unsupported type"};
+        }
+    }
 
-        private:
-            static void encodeString(const std::string& s, std::string& result)
+    [[nodiscard]]
+    inline std::uint64_t hash(const Value& value, const std::uint64_t seed = 0)
+    {
+        class Hasher final
+        {
+        public:
+            static std::uint64_t hash(const Value& value, const std::uint64_t seed)
             {
-                for (const auto c : s)
-                    if (c == '<') result += "&lt;";
-                    else if (c == '>') result += "&gt;";
-                    else if (c == '&') result += "&amp;";
-                    else result.push_back(c);
+                return detail::hashValue(value, seed, &Hasher::hash);
             }
+        };
+
+        return Hasher::hash(value, seed);
+    }
+
+    // Memoizes the hashes of dictionaries and arrays by their storage, which copies of a Value share,
+    // so after a copy is modified only the containers on the path to the change are hashed again.
+    // The cache must be cleared after any of the hashed values are modified in place or destroyed.
+    class HashCache final
+    {
+    public:
+        explicit HashCache(const std::uint64_t s = 0) noexcept: seed{s} {}
+
+        // the same as plist::hash with the seed of the cache
+        [[nodiscard]] std::uint64_t hash(const Value& value)
+        {
+            return hash(value, seed);
+        }
+
+        // shared subtrees are equal and different hashes reject unequal ones without walking them,
+        // so only the subtrees that are equal but not shared are compared member by member
+        [[nodiscard]] bool equal(const Value& first, const Value& second)
+        {
+            return equal(first, second, seed);
+        }
 
-            static void encode(const std::string& s, std::string& result)
+        void clear() noexcept
+        {
+            hashes.clear();
+        }
+
+    private:
+        // the hash of a container depends on the seed of its parent too
+        struct Key final
+        {
+            const void* container;
+            std::uint64_t seed;
+
+            [[nodiscard]] bool operator==(const Key& other) const noexcept
             {
-                result += "<string>";
-                encodeString(s, result);
-                result += "</string>";
+                return container == other.container && seed == other.seed;
             }
+        };
 
-            static void encode(const std::vector<std::byte>& data, std::string& result)
+        struct KeyHasher final
+        {
+            [[nodiscard]] std::size_t operator()(const Key& key) const noexcept
             {
-                result += "<data>";
-                constexpr char chars[] = {
-                    'A', 'B', 'C', 'D', 'E', 'F', 'G', 'H', 'I', 'J', 'K', 'L', 'M',
-                    'N', 'O', 'P', 'Q', 'R', 'S', 'T', 'U', 'V', 'W', 'X', 'Y', 'Z',
-                    'a', 'b', 'c', 'd', 'e', 'f', 'g', 'h', 'i', 'j', 'k', 'l', 'm',
-                    'n', 'o', 'p', 'q', 'r', 's', 't', 'u', 'v', 'w', 'x', 'y', 'z',
-                    '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', '+', '/'
-                };
-                std::size_t c = 0;
-                std::uint8_t charArray[3];
-                for (const auto b : data)
-                {
-                    charArray[c++] = static_cast<std::uint8_t>(b);
-                    if (c == 3)
-                    {
-                        result += chars[static_cast<std::uint8_t>((charArray[0] & 0xFC) >> 2)];
-                        result += chars[static_cast<std::uint8_t>(((charArray[0] & 0x03) << 4) + ((charArray[1] & 0xF0) >> 4))];
-                        result += chars[static_cast<std::uint8_t>(((charArray[1] & 0x0F) << 2) + ((charArray[2] & 0xC0) >> 6))];
-                        result += chars[static_cast<std::uint8_t>(charArray[2] & 0x3f)];
-                        c = 0;
-                    }
-                }
+                return static_cast<std::size_t>(detail::mix(reinterpret_cast<std::uintptr_t>(key.container) ^ detail::hashPrimes[0],
+                                                             key.seed ^ detail::hashPrimes[1]));
+            }
+        };
 
-                if (c)
-                {
-                    result += chars[static_cast<std::uint8_t>((charArray[0] & 0xFC) >> 2)];
+        [[nodiscard]] static const void* getContainer(const Value& value) noexcept
+        {
+            if (const auto dictionary = value.getIf<Dictionary>()) return dictionary;
+            if (const auto array = value.getIf<Array>()) return array;
+            return nullptr;
+        }
 
-                    if (c == 1)
-                        result += chars[static_cast<std::uint8_t>((charArray[0] & 0x03) << 4)];
-                    else // c == 2
-                    {
-                        result += chars[static_cast<std::uint8_t>(((charArray[0] & 0x03) << 4) + ((charArray[1] & 0xF0) >> 4))];
-                        result += chars[static_cast<std::uint8_t>((charArray[1] & 0x0F) << 2)];
-                    }
+        std::uint64_t hash(const Value& value, const std::uint64_t valueSeed)
+        {
+            const auto childHash = [this](const Value& child, const std::uint64_t childSeed) {
+                return hash(child, childSeed);
+            };
+
+            const auto container = getContainer(value);
+            if (!container) return detail::hashValue(value, valueSeed, childHash);
+
+            const Key key{container, valueSeed};
+            if (const auto iterator = hashes.find(key); iterator != hashes.end())
+                return iterator->second;
 
-                    while (++c < 4) result += '=';
+            const auto result = detail::hashValue(value, valueSeed, childHash);
+            hashes.emplace(key, result);
+            return result;
+        }
+
+        bool equal(const Value& first, const Value& second, const std::uint64_t valueSeed)
+        {
+            if (&first == &second) return true;
+
+            const auto firstContainer = getContainer(first);
+            const auto secondContainer = getContainer(second);
+            if (!firstContainer || !secondContainer) return first == second;
+            if (firstContainer == secondContainer) return true;
+            if (first.getType() != second.getType() ||
+                hash(first, valueSeed) != hash(second, valueSeed))
+                return false;
+
+            // the children are hashed with the seed of their parent's type
+            const auto childSeed = detail::hashInteger(static_cast<std::uint64_t>(first.getType()), valueSeed);
+            if (const auto dictionary = first.getIf<Dictionary>())
+            {
+                const auto& other = *second.getIf<Dictionary>();
+                if (dictionary->size() != other.size()) return false;
+                for (const auto& [key, member] : *dictionary)
+                {
+                    const auto iterator = other.find(key);
+                    if (iterator == other.end() || !equal(member, iterator->second, childSeed)) return false;
                 }
-                result += "</data>";
+                return true;
             }
 
-            static void encode(const Dictionary& dictionary,
-                               const bool whiteSpaces,
-                               const std::size_t level,
-                               std::string& result)
+            const auto& array = *first.getIf<Array>();
+            const auto& other = *second.getIf<Array>();
+            if (array.size() != other.size()) return false;
+            for (std::size_t i = 0; i < array.size(); ++i)
+                if (!equal(array[i], other[i], childSeed)) return false;
+            return true;
+        }
+
+        std::uint64_t seed;
+        std::unordered_map<Key, std::uint64_t, KeyHasher> hashes;
+    };
+
+    enum class Conflict
+    {
+        replace, // the member of the source wins
+        keep, // the member of the target wins
+        fail // std::runtime_error is thrown
+    };
+
+    namespace detail
+    {
+        // whether merging the source into the target would find a member in both that are not dictionaries
+        inline bool hasConflict(const Value& target, const Value& source)
+        {
+            const auto targetDictionary = target.getIf<Dictionary>();
+            const auto sourceDictionary = source.getIf<Dictionary>();
+            if (!targetDictionary || !sourceDictionary) return true;
+
+            for (const auto& [key, value] : *sourceDictionary)
             {
-                result += "<dict>";
-                if (whiteSpaces) result.push_back('\n');
-                for (const auto& [key, entryValue] : dictionary)
-                {
-                    if (whiteSpaces) result.insert(result.end(), level + 1, '\t');
-                    result += "<key>";
-                    encodeString(key, result);
-                    result += "</key>";
-                    if (whiteSpaces) result += '\n';
-                    if (whiteSpaces) result.insert(result.end(), level + 1, '\t');
-                    encode(entryValue, result, whiteSpaces, level + 1);
-                    if (whiteSpaces) result += '\n';
-                }
-                result.insert(result.end(), level, '\t');
-                result += "</dict>";
+                const auto iterator = targetDictionary->find(key);
+                if (iterator != targetDictionary->end() && hasConflict(iterator->second, value)) return true;
             }
+            return false;
+        }
 
-            static void encode(const Array& array,
-                               const bool whiteSpaces,
-                               const std::size_t level,
-                               std::string& result)
+        inline void merge(Value& target, Value&& source, const Conflict conflict)
+        {
+            if (target.is<Dictionary>() && source.is<Dictionary>())
             {
-                result += "<array>";
-                if (whiteSpaces) result.push_back('\n');
-                for (const auto& child : array)
+                auto& targetDictionary = target.as<Dictionary>();
+                auto& sourceDictionary = source.as<Dictionary>();
+                targetDictionary.reserve(targetDictionary.size() + sourceDictionary.size());
+
+                for (auto& [key, value] : sourceDictionary)
                 {
-                    if (whiteSpaces) result.insert(result.end(), level + 1, '\t');
-                    encode(child, result, whiteSpaces, level + 1);
-                    if (whiteSpaces) result.push_back('\n');
+                    // the value is moved only if the member is inserted
+                    const auto [iterator, inserted] = targetDictionary.try_emplace(std::move(key), std::move(value));
+                    if (!inserted) merge(iterator->second, std::move(value), conflict);
                 }
-                if (whiteSpaces) result.insert(result.end(), level, '\t');
-                result += "</array>";
             }
+            else
+                switch (conflict)
+                {
+                    case Conflict::replace: target = std::move(source); break;
+                    case Conflict::keep: break;
+                    case Conflict::fail: throw std::runtime_error{"Conflicting member"};
+                }
+        }
+    }
 
-            static void encode(const Value& value,
-                               std::string& result,
-                               const bool whiteSpaces,
-                               const std::size_t level = 0)
-            {
-                if (const auto dictionary = std::get_if<Dictionary>(&value.getValue()))
-                    encode(*dictionary, whiteSpaces, level, result);
-                else if (const auto array = std::get_if<Array>(&value.getValue()))
-                    encode(*array, whiteSpaces, level, result);
-                else if (const auto string = std::get_if<String>(&value.getValue()))
-                    encode(*string, result);
-                else if (const auto real = std::get_if<double>(&value.getValue()))
-                    result += "<real>" + std::to_string(*real) + "</real>";
-                else if (const auto integer = std::get_if<std::int64_t>(&value.getValue()))
-                    result += "<integer>" + std::to_string(*integer) + "</integer>";
-                else if (const auto boolean = std::get_if<bool>(&value.getValue()))
-                    result += *boolean ? "<true/>" : "<false/>";
-                else if (const auto data = std::get_if<Data>(&value.getValue()))
-                    encode(*data, result);
-                else if (std::get_if<Date>(&value.getValue()))
-                    throw std::runtime_error{"Date fields are not supported"};
-                else
-                    throw std::runtime_error{"Unsupported format"};
-            }
-        };
+    // Deep-merges the source into the target. Members that exist in only one of them are kept,
+    // dictionaries that exist in both are merged, and any other member in both is a conflict.
+    // With Conflict::fail the conflicts are looked for first, so the target is unchanged when it throws.
+    // Members of the source are moved, pass it with std::move to avoid copying its subtrees.
+    inline void merge(Value& target, Value source, const Conflict conflict = Conflict::replace)
+    {
+        if (conflict == Conflict::fail && detail::hasConflict(target, source))
+            throw std::runtime_error{"Conflicting member"};
+        detail::merge(target, std::move(source), conflict);
+    }
 
-        switch (format)
+    // Reorders the members of every dictionary in the tree by key. Shared containers are cloned.
+    inline void sortKeys(Value& value)
+    {
+        if (value.is<Dictionary>())
         {
-            case Format::text: return TextEncoder::encode(value, whiteSpaces);
-            case Format::xml: return XmlEncoder::encode(value, whiteSpaces);
+            auto& dictionary = value.as<Dictionary>();
+            dictionary.sort();
+            for (auto& member : dictionary)
+                sortKeys(member.second);
         }
-
-        throw std::runtime_error{"Unsupported format"};
+        else if (value.is<Array>())
+            for (auto& element : value.as<Array>())
+                sortKeys(element);
     }
-}
+
+    // Estimated heap and inline bytes of a tree. Containers shared between copies are counted once,
+    // external data is not counted because the tree does not own its bytes.
+    struct MemoryUsage final
+    {
+        std::size_t nodes = 0; // the Value objects themselves
+        std::size_t containers = 0; // bookkeeping of dictionaries and arrays (key objects, indices, unused capacity, shared blocks)
+        std::size_t keys = 0; // heap bytes of the keys
+        std::size_t strings = 0; // heap bytes of the string values
+        std::size_t data = 0;
+
+        [[nodiscard]] std::size_t getTotal() const noexcept
+        {
+            return nodes + containers + keys + strings + data;
+        }
+    };
+
+    [[nodiscard]]
+    inline MemoryUsage memoryUsage(const Value& value)
+    {
+        class Counter final
+        {
+        public:
+            void count(const Value& v)
+            {
+                constexpr std::size_t sharedBlockSize = 2 * sizeof(void*); // vtable pointer and reference counts
+
+                result.nodes += sizeof(Value);
+
+                if (const auto dictionary = v.getIf<Dictionary>())
+                {
+                    if (dictionary->empty() || !visited.insert(dictionary).second) return;
+
+                    // the block of make_shared, the pointers to the members, the members apart from their values, and the index
+                    result.containers += sizeof(Dictionary) + sharedBlockSize +
+                        dictionary->capacity() * sizeof(void*) +
+                        dictionary->size() * (sizeof(Dictionary::value_type) - sizeof(Value)) +
+                        dictionary->bucket_count() * sizeof(std::uint64_t);
+                    for (const auto& [key, member] : *dictionary)
+                    {
+                        result.keys += heapSize(key);
+                        count(member);
+                    }
+                }
+                else if (const auto array = v.getIf<Array>())
+                {
+                    if (array->empty() || !visited.insert(array).second) return;
+
+                    result.containers += sizeof(Array) + sharedBlockSize + (array->capacity() - array->size()) * sizeof(Value);
+                    for (const auto& element : *array)
+                        count(element);
+                }
+                else if (const auto string = v.getIf<String>())
+                    result.strings += heapSize(*string);
+                else if (const auto data = v.getIf<Data>())
+                    result.data += data->capacity();
+            }
+
+            MemoryUsage result;
+
+        private:
+            // zero for strings stored in the small buffer of the object
+            static std::size_t heapSize(const std::string& s) noexcept
+            {
+                const auto begin = reinterpret_cast<const char*>(&s);
+                const std::less<const char*> less;
+                const auto inlined = !less(s.data(), begin) && less(s.data(), begin + sizeof(s));
+                return inlined ? 0 : s.capacity() + 1;
+            }
+
+            std::unordered_set<const void*> visited;
+        };
+
+        Counter counter;
+        counter.count(value);
+        return counter.result;
+    }
+
+    namespace detail
+    {
+        // bytes written by the hex encoder, or the unfinished group of the base64 encoder,
+        // so that data can be encoded in chunks
+        struct DataState final
+        {
+            std::uint8_t charArray[3];
+            std::size_t c = 0;
+        };
+
+        inline void encodeBase64(const std::byte* bytes,
+                                 const std::size_t size,
+                                 DataState& state,
+                                 std::string& result)
+        {
+            auto& charArray = state.charArray;
+            auto& c = state.c;
+            for (std::size_t i = 0; i < size; ++i)
+            {
+                charArray[c++] = static_cast<std::uint8_t>(bytes[i]);
+                if (c == 3)
+                {
+                    result += base64Chars[static_cast<std::uint8_t>((charArray[0] & 0xFC) >> 2)];
+                    result += base64Chars[static_cast<std::uint8_t>(((charArray[0] & 0x03) << 4) + ((charArray[1] & 0xF0) >> 4))];
+                    result += base64Chars[static_cast<std::uint8_t>(((charArray[1] & 0x0F) << 2) + ((charArray[2] & 0xC0) >> 6))];
+                    result += base64Chars[static_cast<std::uint8_t>(charArray[2] & 0x3f)];
+                    c = 0;
+                }
+            }
+        }
+
+        // writes the unfinished group with padding
+        inline void finishBase64(DataState& state, std::string& result)
+        {
+            auto& charArray = state.charArray;
+            auto& c = state.c;
+            if (c)
+            {
+                result += base64Chars[static_cast<std::uint8_t>((charArray[0] & 0xFC) >> 2)];
+
+                if (c == 1)
+                    result += base64Chars[static_cast<std::uint8_t>((charArray[0] & 0x03) << 4)];
+                else // c == 2
+                {
+                    result += base64Chars[static_cast<std::uint8_t>(((charArray[0] & 0x03) << 4) + ((charArray[1] & 0xF0) >> 4))];
+                    result += base64Chars[static_cast<std::uint8_t>((charArray[1] & 0x0F) << 2)];
+                }
+
+                while (++c < 4) result += '=';
+            }
+        }
+
+        inline void encodeInteger(const std::int64_t integer, std::string& result)
+        {
+            char buffer[24];
+#if defined(__cpp_lib_to_chars)
+            result.append(buffer, std::to_chars(buffer, buffer + sizeof(buffer), integer).ptr);
+#else
+            result.append(buffer, static_cast<std::size_t>(std::snprintf(buffer, sizeof(buffer), "%lld", static_cast<long long>(integer))));
+#endif
+        }
+
+        // the members of a dictionary ordered by key, for KeyOrder::sorted
+        inline std::vector<const Dictionary::value_type*> sortedMembers(const Dictionary& dictionary)
+        {
+            std::vector<const Dictionary::value_type*> result;
+            result.reserve(dictionary.size());
+            for (const auto& member : dictionary) result.push_back(&member);
+            std::sort(result.begin(), result.end(), [](const auto a, const auto b) {
+                return a->first < b->first;
+            });
+            return result;
+        }
+
+        template <typename F>
+        void forEachMember(const Dictionary& dictionary, const KeyOrder keyOrder, F&& function)
+        {
+            if (keyOrder == KeyOrder::sorted)
+                for (const auto member : sortedMembers(dictionary)) function(*member);
+            else
+                for (const auto& member : dictionary) function(member);
+        }
+
+        template <typename Style>
+        class TextEncoder final
+        {
+        public:
+            static void header(const Options&, std::string& result)
+            {
+                result += "// !$*UTF8*$!";
+                Style::endLine(result);
+            }
+
+            static void footer(const Options&, std::string&) noexcept {}
+
+            static void beginDictionary(const Options&, std::size_t, std::string& result)
+            {
+                result.push_back('{');
+            }
+
+            static void beginMember(std::size_t,
+                                    const std::string& key,
+                                    const Options& options,
+                                    const std::size_t level,
+                                    std::string& result)
+            {
+                Style::newLine(result);
+                Style::indent(level + 1, result);
+                encode(key, options, result);
+                if constexpr (Style::pretty) result.push_back(' ');
+                result.push_back('=');
+                if constexpr (Style::pretty) result.push_back(' ');
+            }
+
+            static void endMember(const Options&, std::size_t, std::string& result)
+            {
+                result.push_back(';'); // trailing semicolon is mandatory
+            }
+
+            static void endDictionary(const Options&, const std::size_t level, std::string& result)
+            {
+                Style::newLine(result);
+                Style::indent(level, result);
+                result += "}";
+            }
+
+            static void beginArray(const Options&, std::size_t, std::string& result)
+            {
+                result.push_back('(');
+            }
+
+            static void beginElement(const std::size_t index,
+                                     const Options&,
+                                     const std::size_t level,
+                                     std::string& result)
+            {
+                if (index) result.push_back(','); // trailing comma is optional
+                Style::newLine(result);
+                Style::indent(level + 1, result);
+            }
+
+            static void endElement(const Options&, std::size_t, std::string&) noexcept {}
+
+            static void endArray(const Options&, const std::size_t level, std::string& result)
+            {
+                Style::newLine(result);
+                Style::indent(level, result);
+                result += ')';
+            }
+
+            static void beginData(std::string& result)
+            {
+                result += '<';
+            }
+
+            static void encodeData(const std::byte* bytes,
+                                   const std::size_t size,
+                                   const Options&,
+                                   DataState& state,
+                                   std::string& result)
+            {
+                for (std::size_t i = 0; i < size; ++i)
+                {
+                    if constexpr (Style::pretty) if (state.c++) result.push_back(' ');
+                    constexpr char digits[] = "0123456789ABCDEF";
+                    result += digits[(static_cast<std::size_t>(bytes[i]) >> 4) & 0x0F];
+                    result += digits[static_cast<std::size_t>(bytes[i]) & 0x0F];
+                }
+            }
+
+            static void endData(DataState&, std::string& result)
+            {
+                result += '>';
+            }
+
+            // values other than containers and data
+            static void encodeLeaf(const Value& value, const Options& options, std::string& result)
+            {
+                if (auto string = value.getIf<String>())
+                    encode(*string, options, result);
+                else if (auto real = value.getIf<double>())
+                    result += std::to_string(*real);
+                else if (auto integer = value.getIf<std::int64_t>())
+                    encodeInteger(*integer, result);
+                else if (auto boolean = value.getIf<bool>())
+                    result += *boolean ? "YES" : "NO";
+                else if (value.getIf<Date>())
+                    throw std::runtime_error{"Date fields are not supported"};
+                else
+                    throw std::runtime_error{"Unsupported format"};
+            }
+
+        private:
+            static void encode(const std::string& s, const Options& options, std::string& result)
+            {
+                const auto info = inspectUtf8(s.data(), s.size());
+                if (!info.valid)
+                    throw std::runtime_error{"Invalid UTF-8"};
+
+                if (!s.empty())
+                {
+                    bool hasSpecialChars = false;
+                    for (const auto c : s)
+                        if ((c < 'a' || c > 'z') &&
+                            (c < 'A' || c > 'Z') &&
+                            (c < '0' || c > '9') &&
+                            c != '_' && c != '$' && c != '/' &&
+                            c != ':' && c != '.' && c != '-')
+                        {
+                            hasSpecialChars = true;
+                            break;
+                        }
+
+                    if (hasSpecialChars) result.push_back('"');
+                    if (options.escapeNonAscii && !info.ascii)
+                        encodeEscaped(s, result);
+                    else if (!hasSpecialChars)
+                        result += s; // nothing to escape
+                    else
+                        for (const auto c : s)
+                        {
+                            if (c == '"' || c == '\\') result += '\\';
+                            result += c;
+                        }
+                    if (hasSpecialChars) result.push_back('"');
+                }
+                else
+                    result += "\"\"";
+            }
+
+            static void encodeEscaped(const std::string& s, std::string& result)
+            {
+                for (std::size_t i = 0; i < s.size();)
+                {
+                    char32_t codePoint;
+                    if (!decodeUtf8(s.data(), s.size(), i, codePoint))
+                        throw std::runtime_error{"Invalid UTF-8"};
+
+                    if (codePoint < 0x80)
+                    {
+                        if (codePoint == '"' || codePoint == '\\') result += '\\';
+                        result += static_cast<char>(codePoint);
+                        continue;
+                    }
+
+                    const auto appendEscape = [&result](const char32_t unit) {
+                        constexpr char digits[] = "0123456789abcdef";
+                        result += "\\U";
+                        for (int shift = 12; shift >= 0; shift -= 4)
+                            result += digits[(unit >> shift) & 0x0F];
+                    };
+
+                    if (codePoint >= 0x10000)
+                    {
+                        appendEscape(0xD800 + ((codePoint - 0x10000) >> 10));
+                        appendEscape(0xDC00 + ((codePoint - 0x10000) & 0x3FF));
+                    }
+                    else
+                        appendEscape(codePoint);
+                }
+            }
+        };
+
+        template <typename Style>
+        class XmlEncoder final
+        {
+        public:
+            static void header(const Options&, std::string& result)
+            {
+                result += "<?xml version=\"1.0\" encoding=\"UTF-8\"?>";
+                Style::newLine(result);
+                result += "<!DOCTYPE plist PUBLIC \"-//Apple//DTD PLIST 1.0//EN\" \"http://www.apple.com/DTDs/PropertyList-1.0.dtd\">";
+                Style::newLine(result);
+                result += "<plist version=\"1.0\">";
+                Style::newLine(result);
+            }
+
+            static void footer(const Options&, std::string& result)
+            {
+                Style::newLine(result);
+                result += "</plist>";
+            }
+
+            static void beginDictionary(const Options&, std::size_t, std::string& result)
+            {
+                result += "<dict>";
+                Style::newLine(result);
+            }
+
+            static void beginMember(std::size_t,
+                                    const std::string& key,
+                                    const Options&,
+                                    const std::size_t level,
+                                    std::string& result)
+            {
+                Style::indent(level + 1, result);
+                result += "<key>";
+                encodeString(key, result);
+                result += "</key>";
+                Style::newLine(result);
+                Style::indent(level + 1, result);
+            }
+
+            static void endMember(const Options&, std::size_t, std::string& result)
+            {
+                Style::newLine(result);
+            }
+
+            static void endDictionary(const Options&, const std::size_t level, std::string& result)
+            {
+                Style::indent(level, result);
+                result += "</dict>";
+            }
+
+            static void beginArray(const Options&, std::size_t, std::string& result)
+            {
+                result += "<array>";
+                Style::newLine(result);
+            }
+
+            static void beginElement(std::size_t,
+                                     const Options&,
+                                     const std::size_t level,
+                                     std::string& result)
+            {
+                Style::indent(level + 1, result);
+            }
+
+            static void endElement(const Options&, std::size_t, std::string& result)
+            {
+                Style::newLine(result);
+            }
+
+            static void endArray(const Options&, const std::size_t level, std::string& result)
+            {
+                Style::indent(level, result);
+                result += "</array>";
+            }
+
+            static void beginData(std::string& result)
+            {
+                result += "<data>";
+            }
+
+            static void encodeData(const std::byte* bytes,
+                                   const std::size_t size,
+                                   const Options&,
+                                   DataState& state,
+                                   std::string& result)
+            {
+                encodeBase64(bytes, size, state, result);
+            }
+
+            static void endData(DataState& state, std::string& result)
+            {
+                finishBase64(state, result);
+                result += "</data>";
+            }
+
+            static void encodeLeaf(const Value& value, const Options&, std::string& result)
+            {
+                if (const auto string = value.getIf<String>())
+                {
+                    result += "<string>";
+                    encodeString(*string, result);
+                    result += "</string>";
+                }
+                else if (const auto real = value.getIf<double>())
+                {
+                    result += "<real>";
+                    result += std::to_string(*real);
+                    result += "</real>";
+                }
+                else if (const auto integer = value.getIf<std::int64_t>())
+                {
+                    result += "<integer>";
+                    encodeInteger(*integer, result);
+                    result += "</integer>";
+                }
+                else if (const auto boolean = value.getIf<bool>())
+                    result += *boolean ? "<true/>" : "<false/>";
+                else if (value.getIf<Date>())
+                    throw std::runtime_error{"Date fields are not supported"};
+                else
+                    throw std::runtime_error{"Unsupported format"};
+            }
+
+        private:
+            static void encodeString(const std::string& s, std::string& result)
+            {
+                if (!inspectUtf8(s.data(), s.size()).valid)
+                    throw std::runtime_error{"Invalid UTF-8"};
+
+                // copy the runs between the characters that need an entity at once
+                std::size_t start = 0;
+                for (std::size_t i = 0; i < s.size(); ++i)
+                {
+                    const auto c = s[i];
+                    if (c != '<' && c != '>' && c != '&') continue;
+                    result.append(s, start, i - start);
+                    result += c == '<' ? "&lt;" : c == '>' ? "&gt;" : "&amp;";
+                    start = i + 1;
+                }
+                result.append(s, start, std::string::npos);
+            }
+        };
+
+        template <typename Style>
+        class JsonEncoder final
+        {
+        public:
+            static void header(const Options&, std::string&) noexcept {}
+
+            static void footer(const Options&, std::string&) noexcept {}
+
+            static void beginDictionary(const Options&, std::size_t, std::string& result)
+            {
+                result.push_back('{');
+            }
+
+            static void beginMember(const std::size_t index,
+                                    const std::string& key,
+                                    const Options& options,
+                                    const std::size_t level,
+                                    std::string& result)
+            {
+                if (index) result.push_back(',');
+                Style::newLine(result);
+                Style::indent(level + 1, result);
+                encodeString(key, options, result);
+                result.push_back(':');
+                if constexpr (Style::pretty) result.push_back(' ');
+            }
+
+            static void endMember(const Options&, std::size_t, std::string&) noexcept {}
+
+            static void endDictionary(const Options&, const std::size_t level, std::string& result)
+            {
+                Style::newLine(result);
+                Style::indent(level, result);
+                result.push_back('}');
+            }
+
+            static void beginArray(const Options&, std::size_t, std::string& result)
+            {
+                result.push_back('[');
+            }
+
+            static void beginElement(const std::size_t index,
+                                     const Options&,
+                                     const std::size_t level,
+                                     std::string& result)
+            {
+                if (index) result.push_back(',');
+                Style::newLine(result);
+                Style::indent(level + 1, result);
+            }
+
+            static void endElement(const Options&, std::size_t, std::string&) noexcept {}
+
+            static void endArray(const Options&, const std::size_t level, std::string& result)
+            {
+                Style::newLine(result);
+                Style::indent(level, result);
+                result.push_back(']');
+            }
+
+            static void beginData(std::string& result)
+            {
+                result.push_back('"');
+            }
+
+            static void encodeData(const std::byte* bytes,
+                                   const std::size_t size,
+                                   const Options&,
+                                   DataState& state,
+                                   std::string& result)
+            {
+                encodeBase64(bytes, size, state, result);
+            }
+
+            static void endData(DataState& state, std::string& result)
+            {
+                finishBase64(state, result);
+                result.push_back('"');
+            }
+
+            static void encodeLeaf(const Value& value, const Options& options, std::string& result)
+            {
+                if (const auto string = value.getIf<String>())
+                    encodeString(*string, options, result);
+                else if (const auto real = value.getIf<double>())
+                    encodeReal(*real, result);
+                else if (const auto integer = value.getIf<std::int64_t>())
+                    encodeInteger(*integer, result);
+                else if (const auto boolean = value.getIf<bool>())
+                    result += *boolean ? "true" : "false";
+                else if (const auto date = value.getIf<Date>())
+                    encodeDate(*date, result);
+                else
+                    throw std::runtime_error{"Unsupported format"};
+            }
+
+        private:
+            static void encodeString(const std::string& s, const Options& options, std::string& result)
+            {
+                result.push_back('"');
+                for (std::size_t i = 0; i < s.size();)
+                {
+                    // copy the run that needs no escaping at once
+                    auto plain = countJsonPlain(s.data() + i, s.size() - i);
+                    if (options.escapeNonAscii) plain = countAscii(s.data() + i, plain);
+                    else if (!inspectUtf8(s.data() + i, plain).valid)
+                        throw std::runtime_error{"Invalid UTF-8"};
+                    result.append(s.data() + i, plain);
+                    i += plain;
+                    if (i == s.size()) break;
+
+                    const auto c = s[i];
+                    if (c == '"' || c == '\\')
+                    {
+                        result.push_back('\\');
+                        result.push_back(c);
+                        ++i;
+                    }
+                    else if (c == '\n') { result += "\\n"; ++i; }
+                    else if (c == '\r') { result += "\\r"; ++i; }
+                    else if (c == '\t') { result += "\\t"; ++i; }
+                    else
+                    {
+                        char32_t codePoint;
+                        if (!decodeUtf8(s.data(), s.size(), i, codePoint))
+                            throw std::runtime_error{"Invalid UTF-8"};
+
+                        // other control characters, and non-ASCII characters when escaping them
+                        if (codePoint >= 0x10000)
+                        {
+                            appendEscape(0xD800 + ((codePoint - 0x10000) >> 10), result);
+                            appendEscape(0xDC00 + ((codePoint - 0x10000) & 0x3FF), result);
+                        }
+                        else
+                            appendEscape(codePoint, result);
+                    }
+                }
+                result.push_back('"');
+            }
+
+            static void appendEscape(const char32_t unit, std::string& result)
+            {
+                constexpr char digits[] = "0123456789abcdef";
+                result += "\\u";
+                for (int shift = 12; shift >= 0; shift -= 4)
+                    result += digits[(unit >> shift) & 0x0F];
+            }
+
+            static void encodeReal(const double real, std::string& result)
+            {
+                if (!std::isfinite(real))
+                    throw std::runtime_error{"Non-finite numbers are not supported"};
+
+                char buffer[32];
+#if defined(__cpp_lib_to_chars)
+                const auto end = std::to_chars(buffer, buffer + sizeof(buffer), real).ptr; // shortest round-trip form
+#else
+                const auto end = buffer + std::snprintf(buffer, sizeof(buffer), "%.17g", real);
+#endif
+                result.append(buffer, end);
+
+                // so that the number is read back as a real
+                if (std::find_if(buffer, end, [](const char c) noexcept {
+                    return c == '.' || c == 'e' || c == 'E';
+                }) == end)
+                    result += ".0";
+            }
+
+            // UTC, with the fraction of a second only when there is one
+            static void encodeDate(const Date& date, std::string& result)
+            {
+                const auto seconds = std::chrono::floor<std::chrono::seconds>(date);
+                const auto fraction = std::chrono::duration_cast<std::chrono::nanoseconds>(date - seconds).count();
+                const auto secondsSinceEpoch = static_cast<long long>(seconds.time_since_epoch().count());
+                const auto secondsOfDay = ((secondsSinceEpoch % 86400) + 86400) % 86400;
+
+                // days since 1970-01-01 to the proleptic Gregorian calendar
+                const auto days = (secondsSinceEpoch - secondsOfDay) / 86400 + 719468;
+                const auto era = (days >= 0 ? days : days - 146096) / 146097;
+                const auto dayOfEra = days - era * 146097;
+                const auto yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+                const auto dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+                const auto shiftedMonth = (5 * dayOfYear + 2) / 153; // starting from March
+                const auto day = dayOfYear - (153 * shiftedMonth + 2) / 5 + 1;
+                const auto month = shiftedMonth < 10 ? shiftedMonth + 3 : shiftedMonth - 9;
+                const auto year = yearOfEra + era * 400 + (month <= 2 ? 1 : 0);
+
+                char buffer[48];
+                auto length = std::snprintf(buffer, sizeof(buffer), "\"%04lld-%02lld-%02lldT%02lld:%02lld:%02lld",
+                                            year, month, day,
+                                            secondsOfDay / 3600, secondsOfDay / 60 % 60, secondsOfDay % 60);
+                if (fraction)
+                {
+                    length += std::snprintf(buffer + length, sizeof(buffer) - static_cast<std::size_t>(length),
+                                            ".%09lld", static_cast<long long>(fraction));
+                    while (buffer[length - 1] == '0') --length;
+                }
+                result.append(buffer, static_cast<std::size_t>(length));
+                result += "Z\"";
+            }
+        };
+
+        template <typename Encoder>
+        void encode(const Value& value,
+                    const Options& options,
+                    const std::size_t level,
+                    std::string& result)
+        {
+            if (const auto dictionary = value.getIf<Dictionary>())
+            {
+                Encoder::beginDictionary(options, level, result);
+                std::size_t index = 0;
+                forEachMember(*dictionary, options.keyOrder, [&options, level, &result, &index](const auto& member) {
+                    Encoder::beginMember(index++, member.first, options, level, result);
+                    encode<Encoder>(member.second, options, level + 1, result);
+                    Encoder::endMember(options, level, result);
+                });
+                Encoder::endDictionary(options, level, result);
+            }
+            else if (const auto array = value.getIf<Array>())
+            {
+                Encoder::beginArray(options, level, result);
+                for (std::size_t i = 0; i < array->size(); ++i)
+                {
+                    Encoder::beginElement(i, options, level, result);
+                    encode<Encoder>((*array)[i], options, level + 1, result);
+                    Encoder::endElement(options, level, result);
+                }
+                Encoder::endArray(options, level, result);
+            }
+            else if (const auto data = value.getIf<Data>())
+            {
+                DataState state;
+                Encoder::beginData(result);
+                Encoder::encodeData(data->data(), data->size(), options, state, result);
+                Encoder::endData(state, result);
+            }
+            else if (const auto externalData = value.getIf<ExternalData>())
+            {
+                DataState state;
+                Encoder::beginData(result);
+                externalData->read([options, &state, &result](const std::byte* bytes, const std::size_t size) {
+                    Encoder::encodeData(bytes, size, options, state, result);
+                });
+                Encoder::endData(state, result);
+            }
+            else
+                Encoder::encodeLeaf(value, options, result);
+        }
+
+        template <typename Encoder>
+        void encode(const Value& value, const Options& options, std::string& result)
+        {
+            Encoder::header(options, result);
+            encode<Encoder>(value, options, 0, result);
+            Encoder::footer(options, result);
+        }
+
+        // Keeps its scratch state between documents, so that encoding many documents
+        // with the same encoder does not allocate once the buffers have grown.
+        class BinaryEncoder final
+        {
+        public:
+            void encode(const Value& value, const Options& options, std::string& result)
+            {
+                uniquing = options.uniquing;
+                keyOrder = options.keyOrder;
+                objects.clear();
+                content.clear();
+                std::fill(table.begin(), table.end(), std::size_t{0});
+                uniqueCount = 0;
+
+                const auto topObject = add(value);
+                write(topObject, result);
+            }
+
+        private:
+            // the content of an object is its header followed by the indices of its children,
+            // which are written as references once the reference size is known
+            struct Object final
+            {
+                std::size_t offset;
+                std::size_t headerSize;
+                std::size_t referenceCount;
+                std::uint64_t hash;
+                bool unique; // whether the object is in the table
+                const ExternalData* externalData; // streamed after the header
+            };
+
+            static std::uint8_t byteCount(const std::uint64_t value) noexcept
+            {
+                return value <= 0xFFU ? 1 : value <= 0xFFFFU ? 2 : value <= 0xFFFFFFFFU ? 4 : 8;
+            }
+
+            static void encodeBigEndian(const std::uint64_t value, const std::uint8_t size, std::string& result)
+            {
+                for (auto i = size; i > 0; --i)
+                    result.push_back(static_cast<char>((value >> ((i - 1) * 8)) & 0xFF));
+            }
+
+            static void encodeInteger(const std::int64_t value, std::string& result)
+            {
+                // negative integers are always stored in 8 bytes
+                const auto size = value < 0 ? std::uint8_t{8} : byteCount(static_cast<std::uint64_t>(value));
+                result.push_back(static_cast<char>(0x10 | (size == 1 ? 0 : size == 2 ? 1 : size == 4 ? 2 : 3)));
+                encodeBigEndian(static_cast<std::uint64_t>(value), size, result);
+            }
+
+            static void encodeReal(const std::uint8_t marker, const double value, std::string& result)
+            {
+                std::uint64_t bits;
+                std::memcpy(&bits, &value, sizeof(bits));
+                result.push_back(static_cast<char>(marker));
+                encodeBigEndian(bits, 8, result);
+            }
+
+            static void encodeMarker(const std::uint8_t type, const std::size_t count, std::string& result)
+            {
+                if (count < 0x0F)
+                    result.push_back(static_cast<char>((type << 4) | count));
+                else
+                {
+                    result.push_back(static_cast<char>((type << 4) | 0x0F));
+                    encodeInteger(static_cast<std::int64_t>(count), result);
+                }
+            }
+
+            static void encodeString(const std::string& s, std::string& result)
+            {
+                const auto info = inspectUtf8(s.data(), s.size());
+                if (!info.valid)
+                    throw std::runtime_error{"Invalid UTF-8"};
+
+                if (info.ascii)
+                {
+                    encodeMarker(0x05, s.size(), result);
+                    result += s;
+                }
+                else // non-ASCII strings are stored as UTF-16BE
+                {
+                    encodeMarker(0x06, info.utf16Length, result);
+                    appendUtf16BigEndian(s.data(), s.size(), result);
+                }
+            }
+
+            // adds the object whose header was appended to the content at offset,
+            // followed by the given children
+            std::size_t add(const std::size_t offset,
+                            const std::size_t referenceStart,
+                            const bool dictionary,
+                            const bool unique)
+            {
+                const auto headerSize = content.size() - offset;
+                const auto referenceCount = references.size() - referenceStart;
+
+                // dictionaries reference all of their keys followed by all of their values
+                if (dictionary)
+                    for (std::size_t i = 0; i < referenceCount; i += 2)
+                        content.append(reinterpret_cast<const char*>(&references[referenceStart + i]), sizeof(std::size_t));
+                for (std::size_t i = dictionary ? 1 : 0; i < referenceCount; i += dictionary ? 2 : 1)
+                    content.append(reinterpret_cast<const char*>(&references[referenceStart + i]), sizeof(std::size_t));
+                references.resize(referenceStart);
+
+                const auto size = content.size() - offset;
+                const auto hash = unique ? hashBytes(content.data() + offset, size, 0) : 0;
+
+                if (unique)
+                {
+                    if (table.size() < (uniqueCount + 1) * 2) grow();
+
+                    for (auto i = static_cast<std::size_t>(hash) & (table.size() - 1);; i = (i + 1) & (table.size() - 1))
+                    {
+                        if (const auto index = table[i])
+                        {
+                            const auto& object = objects[index - 1];
+                            if (object.hash == hash &&
+                                object.headerSize + object.referenceCount * sizeof(std::size_t) == size &&
+                                content.compare(object.offset, size, content, offset, size) == 0)
+                            {
+                                content.resize(offset);
+                                return index - 1;
+                            }
+                        }
+                        else
+                        {
+                            table[i] = objects.size() + 1;
+                            ++uniqueCount;
+                            break;
+                        }
+                    }
+                }
+
+                objects.push_back(Object{offset, headerSize, referenceCount, hash, unique, nullptr});
+                return objects.size() - 1;
+            }
+
+            void grow()
+            {
+                table.assign(std::max(table.size() * 2, std::size_t{64}), 0);
+                uniqueCount = 0;
+                for (std::size_t index = 0; index < objects.size(); ++index)
+                {
+                    const auto& object = objects[index];
+                    if (!object.unique) continue;
+
+                    auto i = static_cast<std::size_t>(object.hash) & (table.size() - 1);
+                    while (table[i]) i = (i + 1) & (table.size() - 1);
+                    table[i] = index + 1;
+                    ++uniqueCount;
+                }
+            }
+
+            std::size_t add(const std::string& s)
+            {
+                const auto offset = content.size();
+                encodeString(s, content);
+                return add(offset, references.size(), false, uniquing != Uniquing::none);
+            }
+
+            std::size_t add(const Value& value)
+            {
+                const auto offset = content.size();
+                const auto referenceStart = references.size();
+
+                if (const auto dictionary = value.getIf<Dictionary>())
+                {
+                    forEachMember(*dictionary, keyOrder, [this](const auto& member) {
+                        const auto keyReference = add(member.first);
+                        const auto valueReference = add(member.second);
+                        references.push_back(keyReference);
+                        references.push_back(valueReference);
+                    });
+
+                    // the children were appended after the offset, so the header goes to the end
+                    const auto headerOffset = content.size();
+                    encodeMarker(0x0D, dictionary->size(), content);
+                    return add(headerOffset, referenceStart, true, uniquing == Uniquing::all);
+                }
+                else if (const auto array = value.getIf<Array>())
+                {
+                    for (const auto& child : *array)
+                    {
+                        const auto reference = add(child);
+                        references.push_back(reference);
+                    }
+
+                    const auto headerOffset = content.size();
+                    encodeMarker(0x0A, array->size(), content);
+                    return add(headerOffset, referenceStart, false, uniquing == Uniquing::all);
+                }
+                else if (const auto string = value.getIf<String>())
+                    return add(*string);
+                else if (const auto real = value.getIf<double>())
+                    encodeReal(0x23, *real, content);
+                else if (const auto integer = value.getIf<std::int64_t>())
+                    encodeInteger(*integer, content);
+                else if (const auto boolean = value.getIf<bool>())
+                    content.push_back(*boolean ? '\x09' : '\x08');
+                else if (const auto data = value.getIf<Data>())
+                {
+                    encodeMarker(0x04, data->size(), content);
+                    content.append(reinterpret_cast<const char*>(data->data()), data->size());
+                }
+                else if (const auto externalData = value.getIf<ExternalData>())
+                {
+                    // external bytes are not read twice for uniquing
+                    encodeMarker(0x04, externalData->getSize(), content);
+                    objects.push_back(Object{offset, content.size() - offset, 0, 0, false, externalData});
+                    return objects.size() - 1;
+                }
+                else if (const auto date = value.getIf<Date>())
+                {
+                    // dates are stored as seconds since 2001-01-01T00:00:00Z
+                    constexpr double referenceDate = 978307200.0;
+                    const std::chrono::duration<double> seconds = date->time_since_epoch();
+                    encodeReal(0x33, seconds.count() - referenceDate, content);
+                }
+                else
+                    throw std::runtime_error{"Unsupported format"};
+
+                return add(offset, referenceStart, false, uniquing != Uniquing::none);
+            }
+
+            void write(const std::size_t topObject, std::string& result)
+            {
+                std::size_t size = 8 + content.size() + objects.size() * 8 + 32;
+                for (const auto& object : objects)
+                    if (object.externalData) size += object.externalData->getSize();
+                result.reserve(result.size() + size);
+
+                const auto start = result.size();
+                result += "bplist00";
+
+                const auto referenceSize = byteCount(objects.size() - 1);
+                offsets.clear();
+
+                for (const auto& object : objects)
+                {
+                    offsets.push_back(result.size() - start);
+                    result.append(content, object.offset, object.headerSize);
+                    if (object.externalData)
+                        object.externalData->read([&result](const std::byte* bytes, const std::size_t count) {
+                            result.append(reinterpret_cast<const char*>(bytes), count);
+                        });
+                    for (std::size_t i = 0; i < object.referenceCount; ++i)
+                    {
+                        std::size_t reference;
+                        std::memcpy(&reference, content.data() + object.offset + object.headerSize + i * sizeof(reference), sizeof(reference));
+                        encodeBigEndian(reference, referenceSize, result);
+                    }
+                }
+
+                const auto offsetTableOffset = result.size() - start;
+                const auto offsetSize = byteCount(offsets.back());
+                for (const auto offset : offsets)
+                    encodeBigEndian(offset, offsetSize, result);
+
+                result.append(6, '\0'); // unused bytes and sort version
+                result.push_back(static_cast<char>(offsetSize));
+                result.push_back(static_cast<char>(referenceSize));
+                encodeBigEndian(objects.size(), 8, result);
+                encodeBigEndian(topObject, 8, result);
+                encodeBigEndian(offsetTableOffset, 8, result);
+            }
+
+            Uniquing uniquing = Uniquing::all;
+            KeyOrder keyOrder = KeyOrder::insertion;
+            std::string content;
+            std::vector<Object> objects;
+            std::vector<std::size_t> references;
+            std::vector<std::size_t> table; // open addressing, object index + 1 or 0 if empty
+            std::size_t uniqueCount = 0;
+            std::vector<std::size_t> offsets;
+        };
+
+        // calls the function with the encoder of a textual format, instantiated for the style
+        template <typename Style, typename F>
+        void withEncoder(const Format format, F&& function)
+        {
+            switch (format)
+            {
+                case Format::text: return function(TextEncoder<Style>{});
+                case Format::xml: return function(XmlEncoder<Style>{});
+                case Format::json: return function(JsonEncoder<Style>{});
+                default: throw std::runtime_error{"Unsupported format"};
+            }
+        }
+
+        template <typename F>
+        void withEncoder(const Format format, const Options& options, F&& function)
+        {
+            if (options.whiteSpaces)
+                withEncoder<PrettyStyle>(format, std::forward<F>(function));
+            else
+                withEncoder<CompactStyle>(format, std::forward<F>(function));
+        }
+    }
+
+    // Appends the encoded value to the result, formatted with the given style instead of options.whiteSpaces.
+    template <typename Style>
+    void encodeInto(std::string& result,
+                    const Value& value,
+                    const Format format,
+                    const Options& options = {})
+    {
+        if (format == Format::binary)
+            return detail::BinaryEncoder{}.encode(value, options, result);
+
+        detail::withEncoder<Style>(format, [&value, &options, &result](const auto encoder) {
+            detail::encode<decltype(encoder)>(value, options, result);
+        });
+    }
+
+    // Appends the encoded value to the result.
+    inline void encodeInto(std::string& result,
+                           const Value& value,
+                           const Format format,
+                           const Options& options = {})
+    {
+        if (options.whiteSpaces)
+            encodeInto<PrettyStyle>(result, value, format, options);
+        else
+            encodeInto<CompactStyle>(result, value, format, options);
+    }
+
+    template <typename Style>
+    [[nodiscard]] std::string encode(const Value& value,
+                                     const Format format,
+                                     const Options& options = {})
+    {
+        std::string result;
+        encodeInto<Style>(result, value, format, options);
+        return result;
+    }
+
+    [[nodiscard]]
+    inline std::string encode(const Value& value,
+                              const Format format,
+                              const Options& options)
+    {
+        std::string result;
+        encodeInto(result, value, format, options);
+        return result;
+    }
+
+    // Documents encoded back to back into one buffer, offsets has one more element than there are documents
+    struct Batch final
+    {
+        std::string data;
+        std::vector<std::size_t> offsets;
+
+        [[nodiscard]] std::size_t size() const noexcept
+        {
+            return offsets.empty() ? 0 : offsets.size() - 1;
+        }
+
+        [[nodiscard]] std::string_view operator[](const std::size_t index) const noexcept
+        {
+            return std::string_view{data}.substr(offsets[index], offsets[index + 1] - offsets[index]);
+        }
+    };
+
+    // Reuses its output buffer and scratch state between calls, for encoding many small documents.
+    class Encoder final
+    {
+    public:
+        explicit Encoder(const Format f, const Options& o = {}) noexcept: format{f}, options{o} {}
+
+        // the result stays valid until the next call
+        [[nodiscard]] const std::string& encode(const Value& value)
+        {
+            buffer.clear();
+            encode(value, buffer);
+            return buffer;
+        }
+
+        // appends the encoded value to the result
+        void encode(const Value& value, std::string& result)
+        {
+            if (format == Format::binary)
+                binaryEncoder.encode(value, options, result);
+            else
+                encodeInto(result, value, format, options);
+        }
+
+        // encodes a range of values into the batch, replacing its previous contents
+        template <typename Iterator>
+        void encode(Iterator first, const Iterator last, Batch& batch)
+        {
+            batch.data.clear();
+            batch.offsets.clear();
+            batch.offsets.push_back(0);
+            for (; first != last; ++first)
+            {
+                encode(*first, batch.data);
+                batch.offsets.push_back(batch.data.size());
+            }
+        }
+
+    private:
+        Format format;
+        Options options;
+        std::string buffer;
+        detail::BinaryEncoder binaryEncoder;
+    };
+
+    [[nodiscard]]
+    inline std::string encode(const Value& value,
+                              const Format format,
+                              const bool whiteSpaces = false)
+    {
+        Options options;
+        options.whiteSpaces = whiteSpaces;
+        return encode(value, format, options);
+    }
+
+    // Resumable encoder that produces the output in chunks of bounded size.
+    // It keeps an O(1) snapshot of the value, so the original can be modified while encoding.
+    // The binary format needs the offset table of the whole document, so it is encoded upfront.
+    class ChunkedEncoder final
+    {
+    public:
+        ChunkedEncoder(const Value& value,
+                       const Format f,
+                       const bool whiteSpaces = false):
+            ChunkedEncoder{value, f, Options{whiteSpaces}}
+        {
+        }
+
+        ChunkedEncoder(const Value& value,
+                       const Format f,
+                       const Options& o):
+            root{std::make_unique<const Value>(value)},
+            format{f},
+            options{o}
+        {
+            if (format == Format::binary)
+                pending = encode(*root, format, options);
+            else
+            {
+                detail::withEncoder(format, options, [this](const auto encoder) {
+                    decltype(encoder)::header(options, pending);
+                });
+                stack.push_back(Frame{root.get()});
+            }
+        }
+
+        [[nodiscard]] bool isDone() const noexcept
+        {
+            return stack.empty() && position == pending.size();
+        }
+
+        // Returns the next chunk of at most maxSize bytes (empty when done), maxSize must not be zero.
+        // The chunk stays valid until the next call.
+        [[nodiscard]] std::string_view next(const std::size_t maxSize)
+        {
+            if (maxSize == 0)
+                throw std::invalid_argument{"Chunk size must not be zero"};
+
+            // the returned bytes are dropped only once they are most of the buffer, so that
+            // a large leaf or binary document is not moved forward on every call
+            if (position == pending.size())
+            {
+                pending.clear();
+                position = 0;
+            }
+            else if (position > pending.size() / 2)
+            {
+                pending.erase(0, position);
+                position = 0;
+            }
+
+            if (!stack.empty())
+                detail::withEncoder(format, options, [this, maxSize](const auto encoder) {
+                    while (pending.size() - position < maxSize && !stack.empty())
+                        step<decltype(encoder)>(maxSize - (pending.size() - position));
+                });
+
+            const auto size = std::min(maxSize, pending.size() - position);
+            const std::string_view result{pending.data() + position, size};
+            position += size;
+            return result;
+        }
+
+    private:
+        struct Frame final
+        {
+            const Value* value;
+            bool started = false;
+            std::size_t index = 0; // member of a dictionary, element of an array or byte of data
+            Dictionary::const_iterator iterator{};
+            std::vector<const Dictionary::value_type*> members{}; // with KeyOrder::sorted
+            detail::DataState dataState{};
+        };
+
+        template <typename Encoder>
+        void step(const std::size_t budget)
+        {
+            auto& frame = stack.back();
+            const auto level = stack.size() - 1;
+            const auto& value = *frame.value;
+
+            if (const auto dictionary = value.getIf<Dictionary>())
+            {
+                if (!frame.started)
+                {
+                    Encoder::beginDictionary(options, level, pending);
+                    if (options.keyOrder == KeyOrder::sorted)
+                        frame.members = detail::sortedMembers(*dictionary);
+                    else
+                        frame.iterator = dictionary->begin();
+                    frame.started = true;
+                }
+                else if (frame.index < dictionary->size())
+                {
+                    const auto& member = options.keyOrder == KeyOrder::sorted ? *frame.members[frame.index] : *frame.iterator++;
+                    Encoder::beginMember(frame.index++, member.first, options, level, pending);
+                    stack.push_back(Frame{&member.second}); // invalidates frame
+                }
+                else
+                {
+                    Encoder::endDictionary(options, level, pending);
+                    pop<Encoder>();
+                }
+            }
+            else if (const auto array = value.getIf<Array>())
+            {
+                if (!frame.started)
+                {
+                    Encoder::beginArray(options, level, pending);
+                    frame.started = true;
+                }
+                else if (frame.index < array->size())
+                {
+                    Encoder::beginElement(frame.index, options, level, pending);
+                    const auto child = &(*array)[frame.index++];
+                    stack.push_back(Frame{child}); // invalidates frame
+                }
+                else
+                {
+                    Encoder::endArray(options, level, pending);
+                    pop<Encoder>();
+                }
+            }
+            else if (value.is<Data>() || value.is<ExternalData>())
+            {
+                const auto data = value.getIf<Data>();
+                const auto externalData = value.getIf<ExternalData>();
+                const auto size = data ? data->size() : externalData->getSize();
+
+                if (!frame.started)
+                {
+                    Encoder::beginData(pending);
+                    frame.started = true;
+                }
+                else if (frame.index < size)
+                {
+                    // every byte takes at least one character
+                    const auto count = std::min({size - frame.index, std::max(budget / 2, std::size_t{1}), ExternalData::chunkSize});
+                    if (data)
+                        Encoder::encodeData(data->data() + frame.index, count, options, frame.dataState, pending);
+                    else
+                    {
+                        buffer.resize(count);
+                        externalData->read(frame.index, buffer.data(), count);
+                        Encoder::encodeData(buffer.data(), count, options, frame.dataState, pending);
+                    }
+                    frame.index += count;
+                }
+                else
+                {
+                    Encoder::endData(frame.dataState, pending);
+                    pop<Encoder>();
+                }
+            }
+            else
+            {
+                Encoder::encodeLeaf(value, options, pending);
+                pop<Encoder>();
+            }
+        }
+
+        template <typename Encoder>
+        void pop()
+        {
+            stack.pop_back();
+
+            if (stack.empty())
+                Encoder::footer(options, pending);
+            else if (stack.back().value->is<Dictionary>())
+                Encoder::endMember(options, stack.size() - 1, pending);
+            else
+                Encoder::endElement(options, stack.size() - 1, pending);
+        }
+
+        std::unique_ptr<const Value> root; // kept on the heap, so that the frames stay valid when moved
+        Format format;
+        Options options;
+        std::vector<Frame> stack;
+        std::string pending;
+        std::size_t position = 0; // of the first byte of pending that was not returned yet
+        std::vector<std::byte> buffer;
+    };
+
+    // Resources a decoded document may use. Decoding stops with a ParseError as soon as one is exceeded,
+    // so hostile documents are rejected before their trees are built.
+    struct Limits final
+    {
+        std::size_t maxBytes = std::numeric_limits<std::size_t>::max(); // of the document
+        std::size_t maxNodes = std::numeric_limits<std::size_t>::max(); // values, including the containers
+        std::size_t maxDepth = 512; // of nested containers, it also bounds the recursion of the parser
+    };
+
+    namespace detail
+    {
+        class JsonParser final
+        {
+        public:
+            JsonParser(const std::string_view d, const Limits& l) noexcept: data{d}, limits{l} {}
+
+            [[nodiscard]] Value parse()
+            {
+                if (data.size() > limits.maxBytes) fail("Document is too large");
+
+                auto result = parseValue();
+                skipWhiteSpaces();
+                if (position != data.size()) fail("Unexpected data after the value");
+                return result;
+            }
+
+        private:
+            class Nesting final
+            {
+            public:
+                explicit Nesting(JsonParser& p): parser{p}
+                {
+                    if (++parser.depth > parser.limits.maxDepth) parser.fail("Too deeply nested");
+                }
+
+                ~Nesting() { --parser.depth; }
+
+                Nesting(const Nesting&) = delete;
+                Nesting& operator=(const Nesting&) = delete;
+
+            private:
+                JsonParser& parser;
+            };
+
+            [[noreturn]] void fail(const char* message) const
+            {
+                throw ParseError{std::string{message} + " at offset " + std::to_string(position)};
+            }
+
+            void skipWhiteSpaces() noexcept
+            {
+                while (position < data.size() &&
+                       (data[position] == ' ' || data[position] == '\n' ||
+                        data[position] == '\r' || data[position] == '\t'))
+                    ++position;
+            }
+
+            [[nodiscard]] bool consume(const char c) noexcept
+            {
+                if (position == data.size() || data[position] != c) return false;
+                ++position;
+                return true;
+            }
+
+            [[nodiscard]] bool skipDigits() noexcept
+            {
+                const auto start = position;
+                while (position < data.size() && data[position] >= '0' && data[position] <= '9') ++position;
+                return position != start;
+            }
+
+            void expect(const std::string_view literal)
+            {
+                if (data.substr(position, literal.size()) != literal) fail("Unexpected character");
+                position += literal.size();
+            }
+
+            Value parseValue()
+            {
+                skipWhiteSpaces();
+                if (position == data.size()) fail("Unexpected end of data");
+                if (++nodes > limits.maxNodes) fail("Too many values");
+
+                switch (data[position])
+                {
+                    case '{': return parseObject();
+                    case '[': return parseArray();
+                    case '"': return Value{parseString()};
+                    case 't': expect("true"); return Value{true};
+                    case 'f': expect("false"); return Value{false};
+                    case 'n': fail("Null values are not supported");
+                    default: return parseNumber();
+                }
+            }
+
+            Value parseObject()
+            {
+                const Nesting nesting{*this};
+                ++position; // opening brace
+                Dictionary result;
+                skipWhiteSpaces();
+                if (consume('}')) return Value{std::move(result)};
+
+                for (;;)
+                {
+                    skipWhiteSpaces();
+                    if (position == data.size() || data[position] != '"') fail("Expected a key");
+                    auto key = parseString();
+                    skipWhiteSpaces();
+                    if (!consume(':')) fail("Expected a colon");
+
+                    // the last duplicate wins, at the position of the first one
+                    result.insert_or_assign(std::move(key), parseValue());
+
+                    skipWhiteSpaces();
+                    if (consume('}')) return Value{std::move(result)};
+                    if (!consume(',')) fail("Expected a comma or a closing brace");
+                }
+            }
+
+            Value parseArray()
+            {
+                const Nesting nesting{*this};
+                ++position; // opening bracket
+                Array result;
+                skipWhiteSpaces();
+                if (consume(']')) return Value{std::move(result)};
+
+                for (;;)
+                {
+                    result.push_back(parseValue());
+                    skipWhiteSpaces();
+                    if (consume(']')) return Value{std::move(result)};
+                    if (!consume(',')) fail("Expected a comma or a closing bracket");
+                }
+            }
+
+            std::string parseString()
+            {
+                ++position; // opening quote
+                std::string result;
+
+                for (;;)
+                {
+                    // copy the run that needs no unescaping at once
+                    const auto plain = countJsonPlain(data.data() + position, data.size() - position);
+                    if (!inspectUtf8(data.data() + position, plain).valid) fail("Invalid UTF-8");
+                    result.append(data.data() + position, plain);
+                    position += plain;
+
+                    if (position == data.size()) fail("Unterminated string");
+                    if (consume('"')) return result;
+                    if (!consume('\\')) fail("Control character in a string");
+                    if (position == data.size()) fail("Unterminated string");
+
+                    switch (data[position++])
+                    {
+                        case '"': result.push_back('"'); break;
+                        case '\\': result.push_back('\\'); break;
+                        case '/': result.push_back('/'); break;
+                        case 'b': result.push_back('\b'); break;
+                        case 'f': result.push_back('\f'); break;
+                        case 'n': result.push_back('\n'); break;
+                        case 'r': result.push_back('\r'); break;
+                        case 't': result.push_back('\t'); break;
+                        case 'u': appendUtf8(parseEscapedCodePoint(), result); break;
+                        default: --position; fail("Invalid escape sequence");
+                    }
+                }
+            }
+
+            std::uint32_t parseCodeUnit()
+            {
+                if (data.size() - position < 4) fail("Unterminated string");
+
+                std::uint32_t result = 0;
+                for (std::size_t i = 0; i < 4; ++i, ++position)
+                {
+                    const auto c = data[position];
+                    result <<= 4;
+                    if (c >= '0' && c <= '9') result |= static_cast<std::uint32_t>(c - '0');
+                    else if (c >= 'a' && c <= 'f') result |= static_cast<std::uint32_t>(c - 'a' + 10);
+                    else if (c >= 'A' && c <= 'F') result |= static_cast<std::uint32_t>(c - 'A' + 10);
+                    else fail("Invalid escape sequence");
+                }
+                return result;
+            }
+
+            // the part after \u, surrogate pairs are joined
+            char32_t parseEscapedCodePoint()
+            {
+                const auto unit = parseCodeUnit();
+                if (unit >= 0xDC00 && unit <= 0xDFFF) fail("Unpaired surrogate");
+                if (unit < 0xD800 || unit > 0xDBFF) return unit;
+
+                if (!consume('\\') || !consume('u')) fail("Unpaired surrogate");
+                const auto low = parseCodeUnit();
+                if (low < 0xDC00 || low > 0xDFFF) fail("Unpaired surrogate");
+                return 0x10000 + ((unit - 0xD800) << 10) + (low - 0xDC00);
+            }
+
+            static void appendUtf8(const char32_t codePoint, std::string& result)
+            {
+                if (codePoint < 0x80)
+                    result.push_back(static_cast<char>(codePoint));
+                else if (codePoint < 0x800)
+                {
+                    result.push_back(static_cast<char>(0xC0 | (codePoint >> 6)));
+                    result.push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+                }
+                else if (codePoint < 0x10000)
+                {
+                    result.push_back(static_cast<char>(0xE0 | (codePoint >> 12)));
+                    result.push_back(static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F)));
+                    result.push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+                }
+                else
+                {
+                    result.push_back(static_cast<char>(0xF0 | (codePoint >> 18)));
+                    result.push_back(static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F)));
+                    result.push_back(static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F)));
+                    result.push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+                }
+            }
+
+            // integers that fit into 64 bits stay integers, everything else is read as a real
+            Value parseNumber()
+            {
+                const auto start = position;
+                bool integer = true;
+
+                (void)consume('-');
+                if (!consume('0') && !skipDigits()) fail("Unexpected character");
+                if (consume('.'))
+                {
+                    integer = false;
+                    if (!skipDigits()) fail("Expected a digit");
+                }
+                if (consume('e') || consume('E'))
+                {
+                    integer = false;
+                    if (!consume('+')) (void)consume('-');
+                    if (!skipDigits()) fail("Expected a digit");
+                }
+
+                const auto first = data.data() + start;
+                const auto last = data.data() + position;
+
+                if (integer)
+                {
+#if defined(__cpp_lib_to_chars)
+                    std::int64_t result;
+                    if (std::from_chars(first, last, result).ec == std::errc{})
+                        return Value{result};
+#else
+                    errno = 0;
+                    const auto result = std::strtoll(std::string{first, last}.c_str(), nullptr, 10);
+                    if (errno != ERANGE)
+                        return Value{static_cast<std::int64_t>(result)};
+#endif
+                }
+
+#if defined(__cpp_lib_to_chars)
+                double result;
+                if (std::from_chars(first, last, result).ec != std::errc{})
+                    fail("Number out of range");
+#else
+                const auto result = std::strtod(std::string{first, last}.c_str(), nullptr);
+                if (!std::isfinite(result)) fail("Number out of range");
+#endif
+                return Value{result};
+            }
+
+            std::string_view data;
+            Limits limits;
+            std::size_t position = 0;
+            std::size_t nodes = 0;
+            std::size_t depth = 0;
+        };
+    }
+
+    // Only the JSON format can be decoded. Its strings stay strings, even if they hold base64 data or dates.
+    [[nodiscard]]
+    inline Value decode(const std::string_view data, const Format format, const Limits& limits = {})
+    {
+        switch (format)
+        {
+            case Format::json: return detail::JsonParser{data, limits}.parse();
+            default: throw std::runtime_error{"Unsupported format"};
+        }
+    }
+
+    enum class Operation
+    {
+        set,
+        remove,
+        insert
+    };
+
+    using PathElement = std::variant<std::string, std::size_t>;
+
+    struct Change final
+    {
+        Operation operation;
+        std::vector<PathElement> path;
+        Value value;
+    };
+
+    using Patch = std::vector<Change>;
+
+    [[nodiscard]]
+    inline Patch diff(const Value& source, const Value& target)
+    {
+        class Differ final
+        {
+        public:
+            static void diff(const Value& source,
+                             const Value& target,
+                             std::vector<PathElement>& path,
+                             Patch& patch)
+            {
+                if (&source == &target) return;
+
+                if (source.getType() != target.getType())
+                    patch.push_back(Change{Operation::set, path, target});
+                else if (const auto sourceDictionary = source.getIf<Dictionary>())
+                    diff(*sourceDictionary, *target.getIf<Dictionary>(), path, patch);
+                else if (const auto sourceArray = source.getIf<Array>())
+                    diff(*sourceArray, *target.getIf<Array>(), path, patch);
+                else if (source != target)
+                    patch.push_back(Change{Operation::set, path, target});
+            }
+
+        private:
+            static void diff(const Dictionary& source,
+                             const Dictionary& target,
+                             std::vector<PathElement>& path,
+                             Patch& patch)
+            {
+                if (&source == &target) return; // shared between the snapshots
+
+                // removals and changes in the order of the source, then additions in the order of the target
+                for (const auto& [key, sourceValue] : source)
+                {
+                    path.emplace_back(key);
+                    if (const auto iterator = target.find(key); iterator == target.end())
+                        patch.push_back(Change{Operation::remove, path, Value{}});
+                    else
+                        diff(sourceValue, iterator->second, path, patch);
+                    path.pop_back();
+                }
+
+                for (const auto& [key, targetValue] : target)
+                    if (!source.count(key))
+                    {
+                        path.emplace_back(key);
+                        patch.push_back(Change{Operation::set, path, targetValue});
+                        path.pop_back();
+                    }
+            }
+
+            static void diff(const Array& source,
+                             const Array& target,
+                             std::vector<PathElement>& path,
+                             Patch& patch)
+            {
+                if (&source == &target) return; // shared between the snapshots
+
+                // skip the common prefix and suffix so that a single insertion
+                // or removal does not turn into a change of every following element
+                const auto common = std::min(source.size(), target.size());
+                std::size_t prefix = 0;
+                while (prefix < common && source[prefix] == target[prefix]) ++prefix;
+
+                std::size_t suffix = 0;
+                while (suffix < common - prefix &&
+                       source[source.size() - suffix - 1] == target[target.size() - suffix - 1])
+                    ++suffix;
+
+                const auto sourceEnd = source.size() - suffix;
+                const auto targetEnd = target.size() - suffix;
+                const auto changed = std::min(sourceEnd, targetEnd);
+
+                for (auto i = prefix; i < changed; ++i)
+                {
+                    path.emplace_back(i);
+                    diff(source[i], target[i], path, patch);
+                    path.pop_back();
+                }
+
+                for (auto i = changed; i < targetEnd; ++i)
+                {
+                    path.emplace_back(i);
+                    patch.push_back(Change{Operation::insert, path, target[i]});
+                    path.pop_back();
+                }
+
+                for (auto i = changed; i < sourceEnd; ++i)
+                {
+                    path.emplace_back(changed);
+                    patch.push_back(Change{Operation::remove, path, Value{}});
+                    path.pop_back();
+                }
+            }
+        };
+
+        Patch patch;
+        std::vector<PathElement> path;
+        Differ::diff(source, target, path, patch);
+        return patch;
+    }
+
+    inline void apply(Value& value, const Patch& patch)
+    {
+        for (const auto& change : patch)
+        {
+            if (change.path.empty())
+            {
+                if (change.operation != Operation::set)
+                    throw RangeError{"Invalid path"};
+
+                value = change.value;
+                continue;
+            }
+
+            Value* parent = &value;
+            for (std::size_t i = 0; i + 1 < change.path.size(); ++i)
+            {
+                if (const auto key = std::get_if<std::string>(&change.path[i]))
+                {
+                    auto& dictionary = parent->as<Dictionary>();
+                    const auto iterator = dictionary.find(*key);
+                    if (iterator == dictionary.end())
+                        throw RangeError{"Member does not exist"};
+                    parent = &iterator->second;
+                }
+                else
+                {
+                    auto& array = parent->as<Array>();
+                    const auto index = std::get<std::size_t>(change.path[i]);
+                    if (index >= array.size())
+                        throw RangeError{"Index out of range"};
+                    parent = &array[index];
+                }
+            }
+
+            if (const auto key = std::get_if<std::string>(&change.path.back()))
+            {
+                auto& dictionary = parent->as<Dictionary>();
+                switch (change.operation)
+                {
+                    case Operation::set:
+                    case Operation::insert:
+                        dictionary.insert_or_assign(*key, change.value);
+                        break;
+                    case Operation::remove:
+                        if (!dictionary.erase(*key))
+                            throw RangeError{"Member does not exist"};
+                        break;
+                }
+            }
+            else
+            {
+                auto& array = parent->as<Array>();
+                const auto index = std::get<std::size_t>(change.path.back());
+                switch (change.operation)
+                {
+                    case Operation::set:
+                        if (index >= array.size())
+                            throw RangeError{"Index out of range"};
+                        array[index] = change.value;
+                        break;
+                    case Operation::insert:
+                        if (index > array.size())
+                            throw RangeError{"Index out of range"};
+                        array.insert(array.begin() + static_cast<std::ptrdiff_t>(index), change.value);
+                        break;
+                    case Operation::remove:
+                        if (index >= array.size())
+                            throw RangeError{"Index out of range"};
+                        array.erase(array.begin() + static_cast<std::ptrdiff_t>(index));
+                        break;
+                }
+            }
+        }
+    }
+
+    // converts the patch to a Value, so that it can be encoded with any of the formats
+    [[nodiscard]]
+    inline Value toValue(const Patch& patch)
+    {
+        Array result;
+        result.reserve(patch.size());
+
+        for (const auto& change : patch)
+        {
+            Dictionary entry;
+
+            switch (change.operation)
+            {
+                case Operation::set: entry["op"] = "set"; break;
+                case Operation::remove: entry["op"] = "remove"; break;
+                case Operation::insert: entry["op"] = "insert"; break;
+            }
+
+            Array path;
+            path.reserve(change.path.size());
+            for (const auto& element : change.path)
+                if (const auto key = std::get_if<std::string>(&element))
+                    path.emplace_back(*key);
+                else
+                    path.emplace_back(std::get<std::size_t>(element));
+            entry["path"] = path;
+
+            if (change.operation != Operation::remove)
+                entry["value"] = change.value;
+
+            result.emplace_back(entry);
+        }
+
+        return result;
+    }
+
+    [[nodiscard]]
+    inline Patch toPatch(const Value& value)
+    {
+        Patch result;
+
+        for (const auto& entry : value)
+        {
+            Change change;
+
+            const auto& operation = entry["op"].as<String>();
+            if (operation == "set") change.operation = Operation::set;
+            else if (operation == "remove") change.operation = Operation::remove;
+            else if (operation == "insert") change.operation = Operation::insert;
+            else throw RangeError{"Invalid operation"};
+
+            for (const auto& element : entry["path"])
+                if (element.is<String>())
+                    change.path.emplace_back(element.as<String>());
+                else
+                {
+                    const auto index = element.as<std::int64_t>();
+                    if (index < 0) throw RangeError{"Index out of range"};
+                    change.path.emplace_back(static_cast<std::size_t>(index));
+                }
+
+            if (change.operation != Operation::remove)
+                change.value = entry["value"];
+
+            result.push_back(std::move(change));
+        }
+
+        return result;
+    }
+
+    // Compiled lookup such as "/targets/*/buildSettings/SDKROOT", evaluated without exceptions or allocations.
+    // Segments are escaped like in JSON Pointer ("~0" for '~' and "~1" for '/'), a "*" segment matches
+    // every member of a dictionary or element of an array, and numeric segments also index arrays.
+    class Path final
+    {
+    public:
+        Path() = default;
+
+        explicit Path(const std::string_view expression)
+        {
+            if (expression.empty()) return; // the value itself
+            if (expression.front() != '/') throw ParseError{"Path must start with a slash"};
+
+            for (std::size_t start = 1;;)
+            {
+                const auto end = std::min(expression.find('/', start), expression.size());
+                const auto segment = expression.substr(start, end - start);
+
+                Segment result;
+                if (segment == "*")
+                    result.wildcard = true;
+                else
+                {
+                    for (std::size_t i = 0; i < segment.size(); ++i)
+                        if (segment[i] != '~')
+                            result.key.push_back(segment[i]);
+                        else if (i + 1 < segment.size() && (segment[i + 1] == '0' || segment[i + 1] == '1'))
+                            result.key.push_back(segment[++i] == '0' ? '~' : '/');
+                        else
+                            throw ParseError{"Invalid escape sequence in path"};
+
+                    const auto& key = result.key;
+                    if (!key.empty() && (key.size() == 1 || key.front() != '0') &&
+                        std::all_of(key.begin(), key.end(), [](const char c) noexcept { return c >= '0' && c <= '9'; }))
+                    {
+#if defined(__cpp_lib_to_chars)
+                        if (std::from_chars(key.data(), key.data() + key.size(), result.index).ec != std::errc{})
+                            result.index = std::numeric_limits<std::size_t>::max(); // too large for any array
+#else
+                        errno = 0;
+                        const auto index = std::strtoull(key.c_str(), nullptr, 10);
+                        result.index = errno == ERANGE || index > std::numeric_limits<std::size_t>::max() ?
+                            std::numeric_limits<std::size_t>::max() : // too large for any array
+                            static_cast<std::size_t>(index);
+#endif
+                    }
+                }
+                segments.push_back(std::move(result));
+
+                if (end == expression.size()) break;
+                start = end + 1;
+            }
+        }
+
+        // the first match or null
+        [[nodiscard]] const Value* find(const Value& value) const noexcept
+        {
+            return find(value, 0);
+        }
+
+        // calls the function with every match, in document order
+        template <typename F>
+        void forEach(const Value& value, F&& function) const
+        {
+            forEach(value, 0, function);
+        }
+
+        // appends every match to the result, which allocates only when it has to grow
+        void select(const Value& value, std::vector<const Value*>& result) const
+        {
+            forEach(value, [&result](const Value& match) { result.push_back(&match); });
+        }
+
+    private:
+        struct Segment final
+        {
+            std::string key;
+            std::size_t index = std::numeric_limits<std::size_t>::max(); // when the key is a number
+            bool wildcard = false;
+        };
+
+        [[nodiscard]] const Value* find(const Value& value, const std::size_t level) const noexcept
+        {
+            if (level == segments.size()) return &value;
+            const auto& segment = segments[level];
+
+            if (const auto dictionary = value.getIf<Dictionary>())
+            {
+                if (segment.wildcard)
+                {
+                    for (const auto& entry : *dictionary)
+                        if (const auto result = find(entry.second, level + 1)) return result;
+                }
+                else if (const auto i = dictionary->find(segment.key); i != dictionary->end())
+                    return find(i->second, level + 1);
+            }
+            else if (const auto array = value.getIf<Array>())
+            {
+                if (segment.wildcard)
+                {
+                    for (const auto& element : *array)
+                        if (const auto result = find(element, level + 1)) return result;
+                }
+                else if (segment.index < array->size())
+                    return find((*array)[segment.index], level + 1);
+            }
+
+            return nullptr;
+        }
+
+        template <typename F>
+        void forEach(const Value& value, const std::size_t level, F& function) const
+        {
+            if (level == segments.size())
+            {
+                function(value);
+                return;
+            }
+
+            const auto& segment = segments[level];
+
+            if (const auto dictionary = value.getIf<Dictionary>())
+            {
+                if (segment.wildcard)
+                    for (const auto& entry : *dictionary)
+                        forEach(entry.second, level + 1, function);
+                else if (const auto i = dictionary->find(segment.key); i != dictionary->end())
+                    forEach(i->second, level + 1, function);
+            }
+            else if (const auto array = value.getIf<Array>())
+            {
+                if (segment.wildcard)
+                    for (const auto& element : *array)
+                        forEach(element, level + 1, function);
+                else if (segment.index < array->size())
+                    forEach((*array)[segment.index], level + 1, function);
+            }
+        }
+
+        std::vector<Segment> segments;
+    };
+
+    // Description of the accepted values, compiled into a Validator.
+    struct Schema final
+    {
+        struct Member;
+
+        std::optional<Type> type; // any type when empty
+        // of numbers, or of the size of strings (in bytes), data, arrays and dictionaries,
+        // booleans and dates are never out of range
+        double minimum = -std::numeric_limits<double>::infinity();
+        double maximum = std::numeric_limits<double>::infinity();
+        std::vector<Member> members; // of dictionaries
+        bool additionalMembers = true; // whether dictionaries may have members that are not listed
+        std::shared_ptr<const Schema> elements; // of arrays, any value when null
+    };
+
+    struct Schema::Member final
+    {
+        std::string key;
+        Schema schema;
+        bool required = false;
+    };
+
+    struct Violation final
+    {
+        std::string path; // in the syntax of Path
+        std::string message;
+    };
+
+    // The schema flattened into tables of nodes and sorted members, so that a value is checked in one pass
+    // that looks up each member of a dictionary among the members of its node.
+    class Validator final
+    {
+    public:
+        explicit Validator(const Schema& schema)
+        {
+            compile(schema);
+        }
+
+        [[nodiscard]] std::vector<Violation> validate(const Value& value) const
+        {
+            std::vector<Violation> result;
+            validate(value, result);
+            return result;
+        }
+
+        // appends every violation, returns whether there were none
+        bool validate(const Value& value, std::vector<Violation>& violations) const
+        {
+            const auto count = violations.size();
+            std::string path;
+            validate(value, 0, path, violations);
+            return violations.size() == count;
+        }
+
+    private:
+        static constexpr std::size_t none = std::numeric_limits<std::size_t>::max();
+
+        struct Node final
+        {
+            std::uint32_t types = 0; // a bit for each accepted type
+            double minimum = 0.0;
+            double maximum = 0.0;
+            std::size_t firstMember = 0;
+            std::size_t memberCount = 0;
+            std::size_t requiredCount = 0;
+            std::size_t elements = none;
+            bool additionalMembers = true;
+        };
+
+        struct Member final
+        {
+            std::string key;
+            std::size_t node = 0;
+            bool required = false;
+        };
+
+        static constexpr std::uint32_t bit(const Type type) noexcept
+        {
+            return 1U << static_cast<std::uint32_t>(type);
+        }
+
+        std::size_t compile(const Schema& schema)
+        {
+            const auto index = nodes.size();
+            nodes.emplace_back();
+
+            Node node;
+            node.types = schema.type ? bit(*schema.type) : ~std::uint32_t{0};
+            node.minimum = schema.minimum;
+            node.maximum = schema.maximum;
+            node.additionalMembers = schema.additionalMembers;
+
+            std::vector<const Schema::Member*> sorted;
+            for (const auto& member : schema.members) sorted.push_back(&member);
+            std::sort(sorted.begin(), sorted.end(), [](const auto a, const auto b) { return a->key < b->key; });
+            if (std::adjacent_find(sorted.begin(), sorted.end(), [](const auto a, const auto b) { return a->key == b->key; }) != sorted.end())
+                throw std::runtime_error{"Duplicate member in schema"};
+
+            // the members of a node stay next to each other, the nodes of their schemas come after them
+            node.firstMember = members.size();
+            node.memberCount = sorted.size();
+            members.resize(members.size() + sorted.size());
+            for (std::size_t i = 0; i < sorted.size(); ++i)
+            {
+                const auto child = compile(sorted[i]->schema);
+                members[node.firstMember + i] = Member{sorted[i]->key, child, sorted[i]->required};
+                if (sorted[i]->required) ++node.requiredCount;
+            }
+
+            if (schema.elements) node.elements = compile(*schema.elements);
+
+            nodes[index] = node;
+            return index;
+        }
+
+        static void appendSegment(const std::string& key, std::string& path)
+        {
+            path.push_back('/');
+            for (const auto c : key)
+                if (c == '~') path += "~0";
+                else if (c == '/') path += "~1";
+                else path.push_back(c);
+        }
+
+        // an integer compared with a bound exactly, converting it to a double would round it above 2^53
+        static bool isBelow(const std::int64_t integer, const double bound) noexcept
+        {
+            constexpr double limit = 9223372036854775808.0; // 2^63
+            if (bound >= limit) return true;
+            if (!(bound >= -limit)) return false; // or NaN
+            return integer < static_cast<std::int64_t>(std::ceil(bound));
+        }
+
+        static bool isAbove(const std::int64_t integer, const double bound) noexcept
+        {
+            constexpr double limit = 9223372036854775808.0; // 2^63
+            if (bound < -limit) return true;
+            if (!(bound < limit)) return false; // or NaN
+            return integer > static_cast<std::int64_t>(std::floor(bound));
+        }
+
+        static void report(const std::string& path, const char* message, std::vector<Violation>& violations)
+        {
+            violations.push_back(Violation{path, message});
+        }
+
+        void validate(const Value& value,
+                      const std::size_t index,
+                      std::string& path,
+                      std::vector<Violation>& violations) const
+        {
+            const auto& node = nodes[index];
+            const auto type = value.getType();
+            if (!(node.types & bit(type)))
+                return report(path, "Wrong type", violations);
+
+            const auto isOutOfRange = [&node](const double measure) noexcept {
+                return measure < node.minimum || measure > node.maximum;
+            };
+
+            bool outOfRange = false;
+            if (const auto integer = value.getIf<std::int64_t>())
+                outOfRange = isBelow(*integer, node.minimum) || isAbove(*integer, node.maximum);
+            else if (const auto real = value.getIf<double>()) outOfRange = isOutOfRange(*real);
+            else if (const auto string = value.getIf<String>()) outOfRange = isOutOfRange(static_cast<double>(string->size()));
+            else if (const auto data = value.getIf<Data>()) outOfRange = isOutOfRange(static_cast<double>(data->size()));
+            else if (const auto externalData = value.getIf<ExternalData>()) outOfRange = isOutOfRange(static_cast<double>(externalData->getSize()));
+            else if (const auto array = value.getIf<Array>()) outOfRange = isOutOfRange(static_cast<double>(array->size()));
+            else if (const auto dictionary = value.getIf<Dictionary>()) outOfRange = isOutOfRange(static_cast<double>(dictionary->size()));
+            if (outOfRange)
+                report(path, "Out of range", violations);
+
+            const auto length = path.size();
+
+            if (const auto dictionary = value.getIf<Dictionary>())
+            {
+                // the members of the node are sorted by key
+                const auto first = members.begin() + static_cast<std::ptrdiff_t>(node.firstMember);
+                const auto last = first + static_cast<std::ptrdiff_t>(node.memberCount);
+                std::size_t requiredCount = 0;
+
+                for (const auto& [key, child] : *dictionary)
+                {
+                    appendSegment(key, path);
+                    const auto member = std::lower_bound(first, last, key, [](const Member& m, const std::string& k) {
+                        return m.key < k;
+                    });
+                    if (member != last && member->key == key)
+                    {
+                        if (member->required) ++requiredCount;
+                        validate(child, member->node, path, violations);
+                    }
+                    else if (!node.additionalMembers)
+                        report(path, "Unexpected member", violations);
+                    path.resize(length);
+                }
+
+                // only look for the missing members when some are missing
+                if (requiredCount != node.requiredCount)
+                    for (auto member = first; member != last; ++member)
+                        if (member->required && !dictionary->count(member->key))
+                        {
+                            appendSegment(member->key, path);
+                            report(path, "Missing member", violations);
+                            path.resize(length);
+                        }
+            }
+            else if (const auto array = value.getIf<Array>(); array && node.elements != none)
+                for (std::size_t i = 0; i < array->size(); ++i)
+                {
+                    path.push_back('/');
+                    char buffer[24];
+#if defined(__cpp_lib_to_chars)
+                    path.append(buffer, std::to_chars(buffer, buffer + sizeof(buffer), i).ptr);
+#else
+                    path.append(buffer, static_cast<std::size_t>(std::snprintf(buffer, sizeof(buffer), "%zu", i)));
+#endif
+                    validate((*array)[i], node.elements, path, violations);
+                    path.resize(length);
+                }
+        }
+
+        std::vector<Node> nodes; // the root is the first one
+        std::vector<Member> members;
+    };
+
+    namespace detail
+    {
+        // all children of a container are stored next to each other,
+        // dictionaries store their sorted keys followed by the values
+        struct FrozenNode final
+        {
+            std::uint32_t type;
+            std::uint32_t size;
+            std::uint64_t payload; // value or offset of the children, characters or bytes
+        };
+
+        // in the order of Type, nodes are frozen with the type of their value
+        enum FrozenType: std::uint32_t
+        {
+            frozenDictionary,
+            frozenArray,
+            frozenString,
+            frozenReal,
+            frozenInteger,
+            frozenBoolean,
+            frozenData,
+            frozenDate
+        };
+        static_assert(static_cast<std::uint32_t>(Type::date) == frozenDate);
+
+        constexpr std::uint64_t frozenMagic = 0x31305A4674736C70ULL;
+        constexpr std::size_t frozenHeaderSize = 16;
+
+        [[nodiscard]] inline FrozenNode readFrozenNode(const std::byte* data, const std::size_t offset) noexcept
+        {
+            FrozenNode node;
+            std::memcpy(&node, data + offset, sizeof(node));
+            return node;
+        }
+    }
+
+    // Read-only view of a value inside of a frozen block
+    class FrozenValue final
+    {
+        using Data = std::vector<std::byte>;
+        using String = std::string;
+        using Date = std::chrono::system_clock::time_point;
+
+    public:
+        class Iterator final
+        {
+        public:
+            using iterator_category = std::forward_iterator_tag;
+            using value_type = FrozenValue;
+            using difference_type = std::ptrdiff_t;
+            using pointer = const FrozenValue*;
+            using reference = FrozenValue;
+
+            Iterator(const std::byte* d, const std::size_t o) noexcept: data{d}, offset{o} {}
+
+            [[nodiscard]] FrozenValue operator*() const noexcept { return FrozenValue{data, offset}; }
+
+            Iterator& operator++() noexcept
+            {
+                offset += sizeof(detail::FrozenNode);
+                return *this;
+            }
+
+            Iterator operator++(int) noexcept
+            {
+                const auto result = *this;
+                offset += sizeof(detail::FrozenNode);
+                return result;
+            }
+
+            [[nodiscard]] bool operator==(const Iterator& other) const noexcept { return offset == other.offset; }
+            [[nodiscard]] bool operator!=(const Iterator& other) const noexcept { return offset != other.offset; }
+
+        private:
+            const std::byte* data;
+            std::size_t offset;
+        };
+
+        FrozenValue(const std::byte* d, const std::size_t offset) noexcept:
+            data{d}, node{detail::readFrozenNode(d, offset)}
+        {
+        }
+
+        // Opens a block produced by Frozen (e.g. written to disk and memory-mapped back).
+        // The block must stay alive and unmodified while the returned value is used.
+        // Every node is checked once, so that a truncated or hostile file can not cause reads out of the block.
+        [[nodiscard]] static FrozenValue open(const void* block, const std::size_t size)
+        {
+            const auto result = openUnchecked(block, size);
+            validate(static_cast<const std::byte*>(block), size);
+            return result;
+        }
+
+        // Like open, but checks only the header, for blocks from trusted sources
+        [[nodiscard]] static FrozenValue openUnchecked(const void* block, const std::size_t size)
+        {
+            if (reinterpret_cast<std::uintptr_t>(block) % alignof(std::uint64_t) != 0)
+                throw std::runtime_error{"Frozen data is not aligned"};
+
+            std::uint64_t header[2];
+            if (size < sizeof(header) + sizeof(detail::FrozenNode))
+                throw std::runtime_error{"Invalid frozen data"};
+            std::memcpy(header, block, sizeof(header));
+
+            if (header[0] != detail::frozenMagic || header[1] != size)
+                throw std::runtime_error{"Invalid frozen data"};
+
+            return FrozenValue{static_cast<const std::byte*>(block), detail::frozenHeaderSize};
+        }
+
+        template <typename T, typename std::enable_if_t<std::is_same_v<T, bool>>* = nullptr>
+        [[nodiscard]] bool is() const noexcept
+        {
+            return node.type == detail::frozenBoolean;
+        }
+
+        template <typename T, typename std::enable_if_t<std::is_floating_point_v<T>>* = nullptr>
+        [[nodiscard]] bool is() const noexcept
+        {
+            return node.type == detail::frozenReal;
+        }
+
+        template <typename T, typename std::enable_if_t<std::is_integral_v<T> && !std::is_same_v<T, bool>>* = nullptr>
+        [[nodiscard]] bool is() const noexcept
+        {
+            return node.type == detail::frozenInteger;
+        }
+
+        template <typename T, typename std::enable_if_t<
+            std::is_same_v<T, String> ||
+            std::is_same_v<T, std::string_view> ||
+            std::is_same_v<T, const char*>
+        >* = nullptr>
+        [[nodiscard]] bool is() const noexcept
+        {
+            return node.type == detail::frozenString;
+        }
+
+        template <typename T, typename std::enable_if_t<std::is_same_v<T, Dictionary>>* = nullptr>
+        [[nodiscard]] bool is() const noexcept
+        {
+            return node.type == detail::frozenDictionary;
+        }
+
+        template <typename T, typename std::enable_if_t<std::is_same_v<T, Array>>* = nullptr>
+        [[nodiscard]] bool is() const noexcept
+        {
+            return node.type == detail::frozenArray;
+        }
+
+        template <typename T, typename std::enable_if_t<std::is_same_v<T, Data>>* = nullptr>
+        [[nodiscard]] bool is() const noexcept
+        {
+            return node.type == detail::frozenData;
+        }
+
+        template <typename T, typename std::enable_if_t<std::is_same_v<T, Date>>* = nullptr>
+        [[nodiscard]] bool is() const noexcept
+        {
+            return node.type == detail::frozenDate;
+        }
+
+        template <typename T, typename std::enable_if_t<std::is_same_v<T, bool>>* = nullptr>
+        [[nodiscard]] T as() const
+        {
+            if (node.type == detail::frozenBoolean)
+                return node.payload != 0;
+            else if (node.type == detail::frozenReal)
+                return getReal() != 0.0;
+            else if (node.type == detail::frozenInteger)
+                return node.payload != 0;
+            else
+                throw TypeError{"Wrong type"};
+        }
+
+        template <typename T, typename std::enable_if_t<
+            std::is_arithmetic_v<T> &&
+            !std::is_same_v<T, bool>
+        >* = nullptr>
+        [[nodiscard]] T as() const
+        {
+            if (node.type == detail::frozenReal)
+                return static_cast<T>(getReal());
+            else if (node.type == detail::frozenInteger)
+                return static_cast<T>(static_cast<std::int64_t>(node.payload));
+            else if (node.type == detail::frozenBoolean)
+                return node.payload ? T(1) : T(0);
+            else
+                throw TypeError{"Wrong type"};
+        }
+
+        template <typename T, typename std::enable_if_t<std::is_same_v<T, std::string_view>>* = nullptr>
+        [[nodiscard]] T as() const
+        {
+            if (node.type == detail::frozenString)
+                return std::string_view{reinterpret_cast<const char*>(data + node.payload), node.size};
+            else
+                throw TypeError{"Wrong type"};
+        }
+
+        template <typename T, typename std::enable_if_t<std::is_same_v<T, const char*>>* = nullptr>
+        [[nodiscard]] T as() const
+        {
+            // strings are stored null-terminated
+            if (node.type == detail::frozenString)
+                return reinterpret_cast<const char*>(data + node.payload);
+            else
+                throw TypeError{"Wrong type"};
+        }
+
+        template <typename T, typename std::enable_if_t<std::is_same_v<T, String>>* = nullptr>
+        [[nodiscard]] T as() const
+        {
+            return String{as<std::string_view>()};
+        }
+
+        template <typename T, typename std::enable_if_t<std::is_same_v<T, Data>>* = nullptr>
+        [[nodiscard]] T as() const
+        {
+            const auto [bytes, size] = getBytes();
+            return Data(bytes, bytes + size);
+        }
+
+        template <typename T, typename std::enable_if_t<std::is_same_v<T, Date>>* = nullptr>
+        [[nodiscard]] T as() const
+        {
+            if (node.type == detail::frozenDate)
+                return Date{std::chrono::duration_cast<Date::duration>(std::chrono::nanoseconds{static_cast<std::int64_t>(node.payload)})};
+            else
+                throw TypeError{"Wrong type"};
+        }
+
+        // data bytes without copying them out of the block
+        [[nodiscard]] std::pair<const std::byte*, std::size_t> getBytes() const
+        {
+            if (node.type == detail::frozenData)
+                return {data + node.payload, node.size};
+            else
+                throw TypeError{"Wrong type"};
+        }
+
+        [[nodiscard]] Iterator begin() const
+        {
+            if (node.type == detail::frozenArray)
+                return Iterator{data, static_cast<std::size_t>(node.payload)};
+            else
+                throw TypeError{"Wrong type"};
+        }
+
+        [[nodiscard]] Iterator end() const
+        {
+            if (node.type == detail::frozenArray)
+                return Iterator{data, static_cast<std::size_t>(node.payload) + node.size * sizeof(detail::FrozenNode)};
+            else
+                throw TypeError{"Wrong type"};
+        }
+
+        [[nodiscard]] bool hasMember(const std::string_view member) const
+        {
+            if (node.type == detail::frozenDictionary)
+                return find(member) != node.size;
+            else
+                throw TypeError{"Wrong type"};
+        }
+
+        [[nodiscard]] FrozenValue operator[](const std::string_view member) const
+        {
+            if (node.type == detail::frozenDictionary)
+            {
+                if (const auto index = find(member); index != node.size)
+                    return getMember(index);
+                else
+                    throw RangeError{"Member does not exist"};
+            }
+            else
+                throw TypeError{"Wrong type"};
+        }
+
+        [[nodiscard]] FrozenValue operator[](const std::size_t index) const
+        {
+            if (node.type == detail::frozenArray)
+            {
+                if (index < node.size)
+                    return FrozenValue{data, static_cast<std::size_t>(node.payload) + index * sizeof(detail::FrozenNode)};
+                else
+                    throw RangeError{"Index out of range"};
+            }
+            else
+                throw TypeError{"Wrong type"};
+        }
+
+        [[nodiscard]] bool isEmpty() const
+        {
+            return getSize() == 0;
+        }
+
+        // number of elements of an array or members of a dictionary
+        [[nodiscard]] std::size_t getSize() const
+        {
+            if (node.type == detail::frozenArray || node.type == detail::frozenDictionary)
+                return node.size;
+            else
+                throw TypeError{"Wrong type"};
+        }
+
+        // members of a dictionary in the sorted order of their keys
+        [[nodiscard]] std::string_view getKey(const std::size_t index) const
+        {
+            if (node.type != detail::frozenDictionary)
+                throw TypeError{"Wrong type"};
+            if (index >= node.size)
+                throw RangeError{"Index out of range"};
+
+            return FrozenValue{data, static_cast<std::size_t>(node.payload) + index * sizeof(detail::FrozenNode)}.as<std::string_view>();
+        }
+
+        [[nodiscard]] FrozenValue getMember(const std::size_t index) const
+        {
+            if (node.type != detail::frozenDictionary)
+                throw TypeError{"Wrong type"};
+            if (index >= node.size)
+                throw RangeError{"Index out of range"};
+
+            return FrozenValue{data, static_cast<std::size_t>(node.payload) + (node.size + index) * sizeof(detail::FrozenNode)};
+        }
+
+    private:
+        // Checks the nodes with an explicit stack, so that deep nesting does not overflow the call stack.
+        // Children are always stored after their parent, and a valid block has no more nodes than fit in it,
+        // so the walk ends even if the offsets of a hostile block form cycles or share children.
+        static void validate(const std::byte* data, const std::size_t size)
+        {
+            const auto fail = []() { throw std::runtime_error{"Invalid frozen data"}; };
+            const auto fits = [size](const std::uint64_t offset, const std::uint64_t length) noexcept {
+                return offset <= size && length <= size - offset;
+            };
+
+            std::vector<std::size_t> stack{detail::frozenHeaderSize};
+            std::size_t nodeCount = 0;
+            while (!stack.empty())
+            {
+                const auto offset = stack.back();
+                stack.pop_back();
+                if (++nodeCount > size / sizeof(detail::FrozenNode)) fail();
+
+                const auto current = detail::readFrozenNode(data, offset);
+                switch (current.type)
+                {
+                    case detail::frozenDictionary:
+                    case detail::frozenArray:
+                    {
+                        const std::uint64_t count = current.type == detail::frozenDictionary ? current.size * std::uint64_t{2} : current.size;
+                        if (current.payload % alignof(std::uint64_t) != 0 ||
+                            current.payload < offset + sizeof(detail::FrozenNode) ||
+                            !fits(current.payload, count * sizeof(detail::FrozenNode)))
+                            fail();
+
+                        for (std::uint64_t i = 0; i < count; ++i)
+                        {
+                            const auto child = static_cast<std::size_t>(current.payload + i * sizeof(detail::FrozenNode));
+                            if (i < current.size && current.type == detail::frozenDictionary &&
+                                detail::readFrozenNode(data, child).type != detail::frozenString)
+                                fail(); // keys
+                            stack.push_back(child);
+                        }
+                        break;
+                    }
+                    case detail::frozenString:
+                        // the terminator is needed by as<const char*>
+                        if (!fits(current.payload, current.size + std::uint64_t{1}) ||
+                            data[current.payload + current.size] != std::byte{0})
+                            fail();
+                        break;
+                    case detail::frozenData:
+                        if (!fits(current.payload, current.size)) fail();
+                        break;
+                    case detail::frozenReal:
+                    case detail::frozenInteger:
+                    case detail::frozenBoolean:
+                    case detail::frozenDate:
+                        break;
+                    default:
+                        fail();
+                }
+            }
+        }
+
+        [[nodiscard]] double getReal() const noexcept
+        {
+            double result;
+            std::memcpy(&result, &node.payload, sizeof(result));
+            return result;
+        }
+
+        // binary search of the sorted keys, returns the member count if the key is not found
+        [[nodiscard]] std::size_t find(const std::string_view member) const noexcept
+        {
+            std::size_t first = 0;
+            std::size_t last = node.size;
+            while (first < last)
+            {
+                const auto middle = first + (last - first) / 2;
+                const auto key = detail::readFrozenNode(data, static_cast<std::size_t>(node.payload) + middle * sizeof(detail::FrozenNode));
+                const std::string_view keyString{reinterpret_cast<const char*>(data + key.payload), key.size};
+
+                if (const auto comparison = keyString.compare(member); comparison == 0)
+                    return middle;
+                else if (comparison < 0)
+                    first = middle + 1;
+                else
+                    last = middle;
+            }
+
+            return node.size;
+        }
+
+        const std::byte* data;
+        detail::FrozenNode node;
+    };
+
+    // Immutable copy of a value stored in a single contiguous, relocatable block.
+    // Children are referenced by offsets from the start of the block, so the block can be
+    // written to disk and opened with FrozenValue::open on a machine with the same byte order.
+    class Frozen final
+    {
+    public:
+        explicit Frozen(const Value& value)
+        {
+            class Freezer final
+            {
+            public:
+                static std::size_t getSize(const Value& value)
+                {
+                    if (const auto dictionary = value.getIf<Dictionary>())
+                    {
+                        std::size_t result = dictionary->size() * 2 * sizeof(detail::FrozenNode);
+                        for (const auto& [key, entryValue] : *dictionary)
+                            result += align(key.size() + 1) + getSize(entryValue);
+                        return result;
+                    }
+                    else if (const auto array = value.getIf<Array>())
+                    {
+                        std::size_t result = array->size() * sizeof(detail::FrozenNode);
+                        for (const auto& child : *array)
+                            result += getSize(child);
+                        return result;
+                    }
+                    else if (const auto string = value.getIf<String>())
+                        return align(string->size() + 1);
+                    else if (const auto data = value.getIf<Data>())
+                        return align(data->size());
+                    else if (const auto externalData = value.getIf<ExternalData>())
+                        return align(externalData->getSize());
+                    else
+                        return 0;
+                }
+
+                Freezer(std::byte* b) noexcept: block{b} {}
+
+                void freeze(const Value& value, const std::size_t nodeOffset)
+                {
+                    detail::FrozenNode node{static_cast<std::uint32_t>(value.getType()), 0, 0};
+
+                    if (const auto dictionary = value.getIf<Dictionary>())
+                    {
+                        node.size = getCount(dictionary->size());
+                        node.payload = allocate(dictionary->size() * 2 * sizeof(detail::FrozenNode));
+
+                        // the lookups rely on sorted keys
+                        std::vector<const Dictionary::value_type*> members;
+                        members.reserve(dictionary->size());
+                        for (const auto& member : *dictionary) members.push_back(&member);
+                        std::sort(members.begin(), members.end(), [](const auto a, const auto b) { return a->first < b->first; });
+
+                        for (std::size_t i = 0; i < members.size(); ++i)
+                        {
+                            const auto& [key, entryValue] = *members[i];
+                            const auto keyOffset = static_cast<std::size_t>(node.payload) + i * sizeof(detail::FrozenNode);
+                            write(detail::FrozenNode{detail::frozenString, getCount(key.size()), copy(key.c_str(), key.size() + 1)}, keyOffset);
+                            freeze(entryValue, keyOffset + dictionary->size() * sizeof(detail::FrozenNode));
+                        }
+                    }
+                    else if (const auto array = value.getIf<Array>())
+                    {
+                        node.size = getCount(array->size());
+                        node.payload = allocate(array->size() * sizeof(detail::FrozenNode));
+
+                        for (std::size_t i = 0; i < array->size(); ++i)
+                            freeze((*array)[i], static_cast<std::size_t>(node.payload) + i * sizeof(detail::FrozenNode));
+                    }
+                    else if (const auto string = value.getIf<String>())
+                    {
+                        node.size = getCount(string->size());
+                        node.payload = copy(string->c_str(), string->size() + 1);
+                    }
+                    else if (const auto real = value.getIf<double>())
+                        std::memcpy(&node.payload, real, sizeof(*real));
+                    else if (const auto integer = value.getIf<std::int64_t>())
+                        node.payload = static_cast<std::uint64_t>(*integer);
+                    else if (const auto boolean = value.getIf<bool>())
+                        node.payload = *boolean ? 1 : 0;
+                    else if (const auto data = value.getIf<Data>())
+                    {
+                        node.size = getCount(data->size());
+                        node.payload = copy(data->data(), data->size());
+                    }
+                    else if (const auto externalData = value.getIf<ExternalData>())
+                    {
+                        // frozen blocks are self-contained, so the bytes are copied in
+                        node.type = detail::frozenData;
+                        node.size = getCount(externalData->getSize());
+                        node.payload = allocate(externalData->getSize());
+                        auto destination = block + node.payload;
+                        externalData->read([&destination](const std::byte* bytes, const std::size_t size) {
+                            std::memcpy(destination, bytes, size);
+                            destination += size;
+                        });
+                    }
+                    else if (const auto date = value.getIf<Date>())
+                        node.payload = static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(date->time_since_epoch()).count());
+                    else
+                        throw std::runtime_error{"Unsupported type"};
+
+                    write(node, nodeOffset);
+                }
+
+            private:
+                // payloads are padded to keep the nodes 8-byte aligned
+                static std::size_t align(const std::size_t size) noexcept
+                {
+                    return (size + 7) & ~std::size_t{7};
+                }
+
+                static std::uint32_t getCount(const std::size_t count)
+                {
+                    if (count > std::numeric_limits<std::uint32_t>::max())
+                        throw RangeError{"Value is too large to freeze"};
+                    return static_cast<std::uint32_t>(count);
+                }
+
+                std::size_t allocate(const std::size_t size) noexcept
+                {
+                    const auto result = used;
+                    used += align(size);
+                    return result;
+                }
+
+                std::size_t copy(const void* source, const std::size_t size) noexcept
+                {
+                    const auto result = allocate(size);
+                    if (size) std::memcpy(block + result, source, size);
+                    return result;
+                }
+
+                void write(const detail::FrozenNode& node, const std::size_t nodeOffset) noexcept
+                {
+                    std::memcpy(block + nodeOffset, &node, sizeof(node));
+                }
+
+                std::byte* block;
+                std::size_t used = detail::frozenHeaderSize + sizeof(detail::FrozenNode);
+            };
+
+            const auto size = detail::frozenHeaderSize + sizeof(detail::FrozenNode) + Freezer::getSize(value);
+            storage.resize(size / sizeof(std::uint64_t));
+            storage[0] = detail::frozenMagic;
+            storage[1] = size;
+
+            Freezer freezer{reinterpret_cast<std::byte*>(storage.data())};
+            freezer.freeze(value, detail::frozenHeaderSize);
+        }
+
+        [[nodiscard]] FrozenValue getRoot() const noexcept
+        {
+            return FrozenValue{getData(), detail::frozenHeaderSize};
+        }
+
+        [[nodiscard]] const std::byte* getData() const noexcept
+        {
+            return reinterpret_cast<const std::byte*>(storage.data());
+        }
+
+        [[nodiscard]] std::size_t getSize() const noexcept
+        {
+            return storage.size() * sizeof(std::uint64_t);
+        }
+
+    private:
+        std::vector<std::uint64_t> storage;
+    };
+
+    [[nodiscard]]
+    inline Frozen freeze(const Value& value)
+    {
+        return Frozen{value};
+    }
+
+    [[nodiscard]]
+    inline Value toValue(const FrozenValue& value)
+    {
+        if (value.is<Dictionary>())
+        {
+            Dictionary result;
+            result.reserve(value.getSize());
+            for (std::size_t i = 0; i < value.getSize(); ++i)
+                result.try_emplace(String{value.getKey(i)}, toValue(value.getMember(i)));
+            return result;
+        }
+        else if (value.is<Array>())
+        {
+            Array result;
+            result.reserve(value.getSize());
+            for (const auto child : value)
+                result.push_back(toValue(child));
+            return result;
+        }
+        else if (value.is<String>())
+            return value.as<String>();
+        else if (value.is<double>())
+            return value.as<double>();
+        else if (value.is<std::int64_t>())
+            return value.as<std::int64_t>();
+        else if (value.is<bool>())
+            return value.as<bool>();
+        else if (value.is<Data>())
+            return value.as<Data>();
+        else if (value.is<Date>())
+            return value.as<Date>();
+        else
+            throw std::runtime_error{"Unsupported type"};
+    }
+}
+
+#undef PLIST_SSE2
+#undef PLIST_NEON
 
 #endif // OUZEL_FORMATS_PLIST_HPP
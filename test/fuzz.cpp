@@ -0,0 +1,190 @@
+// Round-trip fuzz target. Built with -DPLIST_LIBFUZZER it is a libFuzzer target (make libfuzzer CXX=clang++),
+// otherwise it is a standalone program that checks seeded random documents and then measures the
+// throughput of the encoders (make fuzz && ./fuzz [runs] [baseline] [log]).
+// Without a baseline only the round trips are checked. Otherwise throughput is measured as the speedup
+// over the reference encoder in the same run, and a run fails when a speedup drops below half of the
+// median in the baseline. fuzz.baseline holds several runs of GCC 12 with -O3, the speedups depend
+// on the compiler, so record a baseline from the log of passing runs for other toolchains.
+// Passing runs are appended to the log.
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <fstream>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "plist.hpp"
+#include "roundtrip.hpp"
+
+extern "C" int LLVMFuzzerTestOneInput(const std::uint8_t* data, const std::size_t size)
+{
+    static roundtrip::Checker checker;
+    checker.check(roundtrip::Generator{data, size}.generate());
+    checker.checkDecoding(std::string_view{reinterpret_cast<const char*>(data), size});
+    return 0;
+}
+
+#if !defined(PLIST_LIBFUZZER)
+namespace
+{
+    struct Throughput final
+    {
+        double encoder; // MB/s
+        double reference; // of the reference encoder of the format, the binary one is compared with compact XML
+        bool sameFormat; // whether the reference writes the same bytes
+
+        double getSpeedup() const noexcept { return encoder / reference; }
+    };
+
+    // documents that every format can encode, about 1 MB in total
+    std::vector<plist::Value> makeCorpus()
+    {
+        std::vector<plist::Value> result;
+        std::size_t size = 0;
+        for (std::uint32_t seed = 0; size < 1000000; ++seed)
+        {
+            auto value = roundtrip::generate(seed);
+            try
+            {
+                // the text formats have no dates and JSON has no infinities
+                for (const auto format : {plist::Format::text, plist::Format::xml, plist::Format::json})
+                    size += plist::encode(value, format, plist::Options{}).size();
+                result.push_back(std::move(value));
+            }
+            catch (const std::runtime_error&)
+            {
+            }
+        }
+        return result;
+    }
+
+    template <typename F>
+    double measure(const std::vector<plist::Value>& corpus, F encode)
+    {
+        using Clock = std::chrono::steady_clock;
+
+        // the best of several rounds, so that a busy machine does not fail the run
+        double best = 0.0;
+        for (int round = 0; round < 5; ++round)
+        {
+            std::size_t bytes = 0;
+            const auto start = Clock::now();
+            for (const auto& value : corpus) bytes += encode(value).size();
+            const std::chrono::duration<double> seconds = Clock::now() - start;
+            best = std::max(best, static_cast<double>(bytes) / 1e6 / seconds.count());
+        }
+        return best;
+    }
+
+    std::map<std::string, Throughput> measureThroughput()
+    {
+        const auto corpus = makeCorpus();
+        std::map<std::string, Throughput> result;
+
+        for (const auto format : {plist::Format::text, plist::Format::xml, plist::Format::json})
+            for (const bool whiteSpaces : {false, true})
+            {
+                plist::Options options;
+                options.whiteSpaces = whiteSpaces;
+                plist::Encoder encoder{format, options};
+                roundtrip::ReferenceEncoder reference{format, options};
+
+                result[roundtrip::describe(format, options)] = Throughput{
+                    measure(corpus, [&encoder](const plist::Value& value) { return encoder.encode(value); }),
+                    measure(corpus, [&reference](const plist::Value& value) { return reference.encode(value); }),
+                    true
+                };
+            }
+
+        // the binary format has a reader instead of a reference encoder
+        plist::Encoder encoder{plist::Format::binary};
+        result["binary"] = Throughput{
+            measure(corpus, [&encoder](const plist::Value& value) { return encoder.encode(value); }),
+            result["xml"].reference,
+            false
+        };
+        return result;
+    }
+
+    // the median of the speedups recorded in previous runs, by name,
+    // from lines of the name, the speedup and the throughput in MB/s
+    std::map<std::string, double> readBaseline(const char* path)
+    {
+        std::map<std::string, std::vector<double>> runs;
+        std::ifstream file{path};
+        for (std::string line; std::getline(file, line);)
+        {
+            const auto last = line.rfind(' ');
+            const auto separator = last == std::string::npos || last == 0 ? std::string::npos : line.rfind(' ', last - 1);
+            if (separator != std::string::npos)
+                runs[line.substr(0, separator)].push_back(std::atof(line.c_str() + separator + 1));
+        }
+
+        std::map<std::string, double> result;
+        for (auto& [name, values] : runs)
+        {
+            std::sort(values.begin(), values.end());
+            result[name] = values[values.size() / 2];
+        }
+        return result;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    const auto runs = argc > 1 ? static_cast<std::uint32_t>(std::strtoul(argv[1], nullptr, 10)) : 10000U;
+
+    roundtrip::Checker checker;
+    for (std::uint32_t seed = 0; seed < runs; ++seed)
+        try
+        {
+            checker.check(roundtrip::generate(seed));
+        }
+        catch (const std::exception& e)
+        {
+            std::fprintf(stderr, "seed %u: %s\n", seed, e.what());
+            return EXIT_FAILURE;
+        }
+    std::printf("%u documents round-tripped\n", runs);
+
+    if (argc < 3) return EXIT_SUCCESS;
+    const auto baseline = readBaseline(argv[2]);
+    const char* log = argc > 3 ? argv[3] : nullptr;
+
+    const auto throughputs = measureThroughput();
+    bool failed = false;
+    for (const auto& [name, throughput] : throughputs)
+    {
+        const auto speedup = throughput.getSpeedup();
+        std::printf("%-18s %8.1f MB/s %6.2fx the reference\n", name.c_str(), throughput.encoder, speedup);
+
+        // timing noise alone can make an encoder that is barely faster than its reference lose a run
+        if (throughput.sameFormat && speedup < 1.0)
+            std::fprintf(stderr, "warning: %s: slower than the reference encoder\n", name.c_str());
+
+        const auto recorded = baseline.find(name);
+        if (recorded != baseline.end() && speedup < recorded->second * 0.5)
+        {
+            std::fprintf(stderr, "%s: speedup regressed from %.2fx\n", name.c_str(), recorded->second);
+            failed = true;
+        }
+    }
+
+    if (failed) return EXIT_FAILURE;
+
+    if (log)
+    {
+        std::ofstream file{log, std::ios::app};
+        for (const auto& [name, throughput] : throughputs)
+            file << name << ' ' << throughput.getSpeedup() << ' ' << throughput.encoder << '\n';
+    }
+
+    return EXIT_SUCCESS;
+}
+#endif
@@ -0,0 +1,518 @@
+// The text, XML and JSON encoders as they were before the formatting became the compile-time
+// Style policy, with a branch on Options::whiteSpaces for every piece of whitespace.
+// They are kept only so that the "Encoding throughput" benchmark can compare against them.
+
+#ifndef PLIST_LEGACY_HPP
+#define PLIST_LEGACY_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include "plist.hpp"
+
+namespace legacy
+{
+    using plist::Date;
+    using plist::Options;
+    using plist::String;
+    using plist::Value;
+    using plist::detail::countAscii;
+    using plist::detail::countJsonPlain;
+    using plist::detail::DataState;
+    using plist::detail::decodeUtf8;
+    using plist::detail::encodeBase64;
+    using plist::detail::finishBase64;
+    using plist::detail::inspectUtf8;
+
+    class TextEncoder final
+    {
+    public:
+        static void header(const Options&, std::string& result)
+        {
+            result += "// !$*UTF8*$!\n";
+        }
+
+        static void footer(const Options&, std::string&) noexcept {}
+
+        static void beginDictionary(const Options&, std::size_t, std::string& result)
+        {
+            result.push_back('{');
+        }
+
+        static void beginMember(std::size_t,
+                                const std::string& key,
+                                const Options& options,
+                                const std::size_t level,
+                                std::string& result)
+        {
+            if (options.whiteSpaces) result.push_back('\n');
+            if (options.whiteSpaces) result.insert(result.end(), level + 1, '\t');
+            encode(key, options, result);
+            if (options.whiteSpaces) result.push_back(' ');
+            result.push_back('=');
+            if (options.whiteSpaces) result.push_back(' ');
+        }
+
+        static void endMember(const Options&, std::size_t, std::string& result)
+        {
+            result.push_back(';'); // trailing semicolon is mandatory
+        }
+
+        static void endDictionary(const Options& options, const std::size_t level, std::string& result)
+        {
+            if (options.whiteSpaces) result.push_back('\n');
+            if (options.whiteSpaces) result.insert(result.end(), level, '\t');
+            result += "}";
+        }
+
+        static void beginArray(const Options&, std::size_t, std::string& result)
+        {
+            result.push_back('(');
+        }
+
+        static void beginElement(const std::size_t index,
+                                 const Options& options,
+                                 const std::size_t level,
+                                 std::string& result)
+        {
+            if (index) result.push_back(','); // trailing comma is optional
+            if (options.whiteSpaces) result.push_back('\n');
+            if (options.whiteSpaces) result.insert(result.end(), level + 1, '\t');
+        }
+
+        static void endElement(const Options&, std::size_t, std::string&) noexcept {}
+
+        static void endArray(const Options& options, const std::size_t level, std::string& result)
+        {
+            if (options.whiteSpaces) result.push_back('\n');
+            if (options.whiteSpaces) result.insert(result.end(), level, '\t');
+            result += ')';
+        }
+
+        static void beginData(std::string& result)
+        {
+            result += '<';
+        }
+
+        static void encodeData(const std::byte* bytes,
+                               const std::size_t size,
+                               const Options& options,
+                               DataState& state,
+                               std::string& result)
+        {
+            for (std::size_t i = 0; i < size; ++i)
+            {
+                if (options.whiteSpaces && state.c++) result.push_back(' ');
+                constexpr char digits[] = "0123456789ABCDEF";
+                result += digits[(static_cast<std::size_t>(bytes[i]) >> 4) & 0x0F];
+                result += digits[static_cast<std::size_t>(bytes[i]) & 0x0F];
+            }
+        }
+
+        static void endData(DataState&, std::string& result)
+        {
+            result += '>';
+        }
+
+        // values other than containers and data
+        static void encodeLeaf(const Value& value, const Options& options, std::string& result)
+        {
+            if (auto string = value.getIf<String>())
+                encode(*string, options, result);
+            else if (auto real = value.getIf<double>())
+                result += std::to_string(*real);
+            else if (auto integer = value.getIf<std::int64_t>())
+                result += std::to_string(*integer);
+            else if (auto boolean = value.getIf<bool>())
+                result += *boolean ? "YES" : "NO";
+            else if (value.getIf<Date>())
+                throw std::runtime_error{"Date fields are not supported"};
+            else
+                throw std::runtime_error{"Unsupported format"};
+        }
+
+    private:
+        static void encode(const std::string& s, const Options& options, std::string& result)
+        {
+            const auto info = inspectUtf8(s.data(), s.size());
+            if (!info.valid)
+                throw std::runtime_error{"Invalid UTF-8"};
+
+            if (!s.empty())
+            {
+                bool hasSpecialChars = false;
+                for (const auto c : s)
+                    if ((c < 'a' || c > 'z') &&
+                        (c < 'A' || c > 'Z') &&
+                        (c < '0' || c > '9') &&
+                        c != '_' && c != '$' && c != '/' &&
+                        c != ':' && c != '.' && c != '-')
+                    {
+                        hasSpecialChars = true;
+                        break;
+                    }
+
+                if (hasSpecialChars) result.push_back('"');
+                if (options.escapeNonAscii && !info.ascii)
+                    encodeEscaped(s, result);
+                else
+                    for (const auto c : s)
+                    {
+                        if (c == '"' || c == '\\') result += '\\';
+                        result += c;
+                    }
+                if (hasSpecialChars) result.push_back('"');
+            }
+            else
+                result += "\"\"";
+        }
+
+        static void encodeEscaped(const std::string& s, std::string& result)
+        {
+            for (std::size_t i = 0; i < s.size();)
+            {
+                char32_t codePoint;
+                if (!decodeUtf8(s.data(), s.size(), i, codePoint))
+                    throw std::runtime_error{"Invalid UTF-8"};
+
+                if (codePoint < 0x80)
+                {
+                    if (codePoint == '"' || codePoint == '\\') result += '\\';
+                    result += static_cast<char>(codePoint);
+                    continue;
+                }
+
+                const auto appendEscape = [&result](const char32_t unit) {
+                    constexpr char digits[] = "0123456789abcdef";
+                    result += "\\U";
+                    for (int shift = 12; shift >= 0; shift -= 4)
+                        result += digits[(unit >> shift) & 0x0F];
+                };
+
+                if (codePoint >= 0x10000)
+                {
+                    appendEscape(0xD800 + ((codePoint - 0x10000) >> 10));
+                    appendEscape(0xDC00 + ((codePoint - 0x10000) & 0x3FF));
+                }
+                else
+                    appendEscape(codePoint);
+            }
+        }
+    };
+
+    class XmlEncoder final
+    {
+    public:
+        static void header(const Options& options, std::string& result)
+        {
+            result += options.whiteSpaces ?
+                "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+                "<!DOCTYPE plist PUBLIC \"-//Apple//DTD PLIST 1.0//EN\" \"http://www.apple.com/DTDs/PropertyList-1.0.dtd\">\n"
+                "<plist version=\"1.0\">\n" :
+                "<?xml version=\"1.0\" encoding=\"UTF-8\"?>"
+                "<!DOCTYPE plist PUBLIC \"-//Apple//DTD PLIST 1.0//EN\" \"http://www.apple.com/DTDs/PropertyList-1.0.dtd\">"
+                "<plist version=\"1.0\">";
+        }
+
+        static void footer(const Options& options, std::string& result)
+        {
+            if (options.whiteSpaces) result.push_back('\n');
+            result += "</plist>";
+        }
+
+        static void beginDictionary(const Options& options, std::size_t, std::string& result)
+        {
+            result += "<dict>";
+            if (options.whiteSpaces) result.push_back('\n');
+        }
+
+        static void beginMember(std::size_t,
+                                const std::string& key,
+                                const Options& options,
+                                const std::size_t level,
+                                std::string& result)
+        {
+            if (options.whiteSpaces) result.insert(result.end(), level + 1, '\t');
+            result += "<key>";
+            encodeString(key, result);
+            result += "</key>";
+            if (options.whiteSpaces) result += '\n';
+            if (options.whiteSpaces) result.insert(result.end(), level + 1, '\t');
+        }
+
+        static void endMember(const Options& options, std::size_t, std::string& result)
+        {
+            if (options.whiteSpaces) result += '\n';
+        }
+
+        static void endDictionary(const Options& options, const std::size_t level, std::string& result)
+        {
+            if (options.whiteSpaces) result.insert(result.end(), level, '\t');
+            result += "</dict>";
+        }
+
+        static void beginArray(const Options& options, std::size_t, std::string& result)
+        {
+            result += "<array>";
+            if (options.whiteSpaces) result.push_back('\n');
+        }
+
+        static void beginElement(std::size_t,
+                                 const Options& options,
+                                 const std::size_t level,
+                                 std::string& result)
+        {
+            if (options.whiteSpaces) result.insert(result.end(), level + 1, '\t');
+        }
+
+        static void endElement(const Options& options, std::size_t, std::string& result)
+        {
+            if (options.whiteSpaces) result.push_back('\n');
+        }
+
+        static void endArray(const Options& options, const std::size_t level, std::string& result)
+        {
+            if (options.whiteSpaces) result.insert(result.end(), level, '\t');
+            result += "</array>";
+        }
+
+        static void beginData(std::string& result)
+        {
+            result += "<data>";
+        }
+
+        static void encodeData(const std::byte* bytes,
+                               const std::size_t size,
+                               const Options&,
+                               DataState& state,
+                               std::string& result)
+        {
+            encodeBase64(bytes, size, state, result);
+        }
+
+        static void endData(DataState& state, std::string& result)
+        {
+            finishBase64(state, result);
+            result += "</data>";
+        }
+
+        static void encodeLeaf(const Value& value, const Options&, std::string& result)
+        {
+            if (const auto string = value.getIf<String>())
+            {
+                result += "<string>";
+                encodeString(*string, result);
+                result += "</string>";
+            }
+            else if (const auto real = value.getIf<double>())
+                result += "<real>" + std::to_string(*real) + "</real>";
+            else if (const auto integer = value.getIf<std::int64_t>())
+                result += "<integer>" + std::to_string(*integer) + "</integer>";
+            else if (const auto boolean = value.getIf<bool>())
+                result += *boolean ? "<true/>" : "<false/>";
+            else if (value.getIf<Date>())
+                throw std::runtime_error{"Date fields are not supported"};
+            else
+                throw std::runtime_error{"Unsupported format"};
+        }
+
+    private:
+        static void encodeString(const std::string& s, std::string& result)
+        {
+            if (!inspectUtf8(s.data(), s.size()).valid)
+                throw std::runtime_error{"Invalid UTF-8"};
+
+            for (const auto c : s)
+                if (c == '<') result += "&lt;";
+                else if (c == '>') result += "&gt;";
+                else if (c == '&') result += "&amp;";
+                else result.push_back(c);
+        }
+    };
+
+    class JsonEncoder final
+    {
+    public:
+        static void header(const Options&, std::string&) noexcept {}
+
+        static void footer(const Options&, std::string&) noexcept {}
+
+        static void beginDictionary(const Options&, std::size_t, std::string& result)
+        {
+            result.push_back('{');
+        }
+
+        static void beginMember(const std::size_t index,
+                                const std::string& key,
+                                const Options& options,
+                                const std::size_t level,
+                                std::string& result)
+        {
+            if (index) result.push_back(',');
+            if (options.whiteSpaces) result.push_back('\n');
+            if (options.whiteSpaces) result.insert(result.end(), level + 1, '\t');
+            encodeString(key, options, result);
+            result.push_back(':');
+            if (options.whiteSpaces) result.push_back(' ');
+        }
+
+        static void endMember(const Options&, std::size_t, std::string&) noexcept {}
+
+        static void endDictionary(const Options& options, const std::size_t level, std::string& result)
+        {
+            if (options.whiteSpaces) result.push_back('\n');
+            if (options.whiteSpaces) result.insert(result.end(), level, '\t');
+            result.push_back('}');
+        }
+
+        static void beginArray(const Options&, std::size_t, std::string& result)
+        {
+            result.push_back('[');
+        }
+
+        static void beginElement(const std::size_t index,
+                                 const Options& options,
+                                 const std::size_t level,
+                                 std::string& result)
+        {
+            if (index) result.push_back(',');
+            if (options.whiteSpaces) result.push_back('\n');
+            if (options.whiteSpaces) result.insert(result.end(), level + 1, '\t');
+        }
+
+        static void endElement(const Options&, std::size_t, std::string&) noexcept {}
+
+        static void endArray(const Options& options, const std::size_t level, std::string& result)
+        {
+            if (options.whiteSpaces) result.push_back('\n');
+            if (options.whiteSpaces) result.insert(result.end(), level, '\t');
+            result.push_back(']');
+        }
+
+        static void beginData(std::string& result)
+        {
+            result.push_back('"');
+        }
+
+        static void encodeData(const std::byte* bytes,
+                               const std::size_t size,
+                               const Options&,
+                               DataState& state,
+                               std::string& result)
+        {
+            encodeBase64(bytes, size, state, result);
+        }
+
+        static void endData(DataState& state, std::string& result)
+        {
+            finishBase64(state, result);
+            result.push_back('"');
+        }
+
+        static void encodeLeaf(const Value& value, const Options& options, std::string& result)
+        {
+            if (const auto string = value.getIf<String>())
+                encodeString(*string, options, result);
+            else if (const auto real = value.getIf<double>())
+                encodeReal(*real, result);
+            else if (const auto integer = value.getIf<std::int64_t>())
+                plist::detail::encodeInteger(*integer, result);
+            else if (const auto boolean = value.getIf<bool>())
+                result += *boolean ? "true" : "false";
+            else if (value.getIf<Date>()) // unchanged, and not in the benchmarks
+                plist::detail::JsonEncoder<plist::CompactStyle>::encodeLeaf(value, options, result);
+            else
+                throw std::runtime_error{"Unsupported format"};
+        }
+
+    private:
+        static void encodeString(const std::string& s, const Options& options, std::string& result)
+        {
+            result.push_back('"');
+            for (std::size_t i = 0; i < s.size();)
+            {
+                // copy the run that needs no escaping at once
+                auto plain = countJsonPlain(s.data() + i, s.size() - i);
+                if (options.escapeNonAscii) plain = countAscii(s.data() + i, plain);
+                else if (!inspectUtf8(s.data() + i, plain).valid)
+                    throw std::runtime_error{"Invalid UTF-8"};
+                result.append(s.data() + i, plain);
+                i += plain;
+                if (i == s.size()) break;
+
+                const auto c = s[i];
+                if (c == '"' || c == '\\')
+                {
+                    result.push_back('\\');
+                    result.push_back(c);
+                    ++i;
+                }
+                else if (c == '\n') { result += "\\n"; ++i; }
+                else if (c == '\r') { result += "\\r"; ++i; }
+                else if (c == '\t') { result += "\\t"; ++i; }
+                else
+                {
+                    char32_t codePoint;
+                    if (!decodeUtf8(s.data(), s.size(), i, codePoint))
+                        throw std::runtime_error{"Invalid UTF-8"};
+
+                    // other control characters, and non-ASCII characters when escaping them
+                    if (codePoint >= 0x10000)
+                    {
+                        appendEscape(0xD800 + ((codePoint - 0x10000) >> 10), result);
+                        appendEscape(0xDC00 + ((codePoint - 0x10000) & 0x3FF), result);
+                    }
+                    else
+                        appendEscape(codePoint, result);
+                }
+            }
+            result.push_back('"');
+        }
+
+        static void appendEscape(const char32_t unit, std::string& result)
+        {
+            constexpr char digits[] = "0123456789abcdef";
+            result += "\\u";
+            for (int shift = 12; shift >= 0; shift -= 4)
+                result += digits[(unit >> shift) & 0x0F];
+        }
+
+        static void encodeReal(const double real, std::string& result)
+        {
+            if (!std::isfinite(real))
+                throw std::runtime_error{"Non-finite numbers are not supported"};
+
+            char buffer[32];
+#if defined(__cpp_lib_to_chars)
+            const auto end = std::to_chars(buffer, buffer + sizeof(buffer), real).ptr; // shortest round-trip form
+#else
+            const auto end = buffer + std::snprintf(buffer, sizeof(buffer), "%.17g", real);
+#endif
+            result.append(buffer, end);
+
+            // so that the number is read back as a real
+            if (std::find_if(buffer, end, [](const char c) noexcept {
+                return c == '.' || c == 'e' || c == 'E';
+            }) == end)
+                result += ".0";
+        }
+    };
+
+    inline void encodeInto(std::string& result,
+                           const Value& value,
+                           const plist::Format format,
+                           const Options& options)
+    {
+        switch (format)
+        {
+            case plist::Format::text: plist::detail::encode<TextEncoder>(value, options, result); break;
+            case plist::Format::xml: plist::detail::encode<XmlEncoder>(value, options, result); break;
+            case plist::Format::json: plist::detail::encode<JsonEncoder>(value, options, result); break;
+            default: throw std::runtime_error{"Unsupported format"};
+        }
+    }
+}
+
+#endif // PLIST_LEGACY_HPP
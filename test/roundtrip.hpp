@@ -0,0 +1,1065 @@
+// Randomized round-trip harness shared by the Catch2 tests and the fuzz target in fuzz.cpp.
+// Random documents are encoded in every format and compared against straightforward
+// reference encoders (and a reference binary reader), so that the optimized encoders
+// are checked against code that is simple enough to be obviously right.
+
+#ifndef PLIST_ROUNDTRIP_HPP
+#define PLIST_ROUNDTRIP_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "plist.hpp"
+
+namespace roundtrip
+{
+    // thrown when an encoder disagrees with the reference, as opposed to the runtime errors of invalid documents
+    class Mismatch final: public std::logic_error
+    {
+    public:
+        using std::logic_error::logic_error;
+    };
+
+    // Builds a document from the given bytes, so that a fuzzer mutating them explores the documents.
+    // Running out of bytes produces leaves, so every input ends in a bounded document.
+    class Generator final
+    {
+    public:
+        Generator(const std::uint8_t* d, const std::size_t s) noexcept: data{d}, size{s} {}
+
+        [[nodiscard]] plist::Value generate()
+        {
+            return generateValue(0);
+        }
+
+    private:
+        static constexpr std::size_t maxDepth = 5;
+        static constexpr std::size_t maxNodes = 2000;
+
+        std::uint8_t next() noexcept
+        {
+            return position < size ? data[position++] : 0;
+        }
+
+        std::uint64_t next(const std::size_t byteCount) noexcept
+        {
+            std::uint64_t result = 0;
+            for (std::size_t i = 0; i < byteCount; ++i)
+                result = (result << 8) | next();
+            return result;
+        }
+
+        std::size_t nextCount() noexcept
+        {
+            // mostly small containers, sometimes ones that need an index or a long count marker
+            const auto c = next();
+            return c < 240 ? c % 8 : c % 64;
+        }
+
+        plist::Value generateValue(const std::size_t depth)
+        {
+            ++nodes;
+            auto kind = next() % 16;
+            if (kind >= 11 && (depth >= maxDepth || nodes >= maxNodes)) kind = 5;
+
+            switch (kind)
+            {
+                case 0: return (next() & 1) != 0;
+                case 1: case 2: return generateInteger();
+                case 3: case 4: return generateReal();
+                case 5: case 6: case 7: return generateString();
+                case 8: return generateData();
+                case 9: return generateExternalData();
+                case 10: return generateDate();
+                case 11: case 12:
+                {
+                    plist::Array array;
+                    for (auto count = nextCount(); count > 0 && nodes < maxNodes; --count)
+                        array.push_back(generateValue(depth + 1));
+                    return array;
+                }
+                default:
+                {
+                    plist::Dictionary dictionary;
+                    for (auto count = nextCount(); count > 0 && nodes < maxNodes; --count)
+                    {
+                        auto key = generateString();
+                        dictionary[std::move(key)] = generateValue(depth + 1);
+                    }
+                    return dictionary;
+                }
+            }
+        }
+
+        std::int64_t generateInteger() noexcept
+        {
+            switch (next() % 4)
+            {
+                case 0: return static_cast<std::int8_t>(next());
+                case 1: return static_cast<std::int16_t>(next(2));
+                case 2: return static_cast<std::int32_t>(next(4));
+                default: return static_cast<std::int64_t>(next(8));
+            }
+        }
+
+        double generateReal() noexcept
+        {
+            constexpr double specials[] = {
+                0.0, -0.0, 0.1, 0.5, 1e-7, 1e21, 1e300, 123456789012345678.0,
+                std::numeric_limits<double>::max(),
+                std::numeric_limits<double>::min(),
+                std::numeric_limits<double>::denorm_min(),
+                std::numeric_limits<double>::infinity(),
+                -std::numeric_limits<double>::infinity()
+            };
+
+            switch (next() % 5)
+            {
+                case 0: return static_cast<double>(static_cast<std::int16_t>(next(2)));
+                case 1: return static_cast<double>(static_cast<std::int32_t>(next(4))) / 1024.0;
+                case 2: return specials[next() % (sizeof(specials) / sizeof(specials[0]))];
+                case 3:
+                {
+                    float real;
+                    const auto bits = static_cast<std::uint32_t>(next(4));
+                    std::memcpy(&real, &bits, sizeof(real));
+                    return std::isnan(real) ? 0.25 : static_cast<double>(real);
+                }
+                default:
+                {
+                    double real;
+                    const auto bits = next(8);
+                    std::memcpy(&real, &bits, sizeof(real));
+                    return std::isnan(real) ? -0.75 : real; // NaN never compares equal after decoding
+                }
+            }
+        }
+
+        std::string generateString()
+        {
+            static const std::string_view pieces[] = {
+                "a", "Z", "0", "_", "$", "/", ":", ".", "-", " ", "=", ";", ",", "{", "(",
+                "\"", "\\", "<", ">", "&", "\n", "\r", "\t", "\x01", "\x1F", "\x7F", std::string_view{"\0", 1},
+                "abcdefghijklmnopqrstuvwxyz0123456789", // long runs take the SIMD paths
+                "\xC3\xA9", "\xE2\x82\xAC", "\xED\x9F\xBF", "\xEF\xBF\xBF", "\xF0\x9F\x98\x80", "\xF4\x8F\xBF\xBF"
+            };
+            static const std::string_view invalidPieces[] = {
+                "\xFF", "\x80", "\xC0\x80", "\xC3", "\xED\xA0\x80", "\xF4\x90\x80\x80", "\xE2\x82"
+            };
+
+            std::string result;
+            const std::size_t length = next() % 24;
+            for (std::size_t i = 0; i < length; ++i)
+                result += pieces[next() % (sizeof(pieces) / sizeof(pieces[0]))];
+
+            if (next() == 0xFF) // rarely, so that most documents can be encoded
+            {
+                const auto offset = result.empty() ? 0 : next() % result.size();
+                result.insert(offset, invalidPieces[next() % (sizeof(invalidPieces) / sizeof(invalidPieces[0]))]);
+            }
+            return result;
+        }
+
+        plist::Data generateData()
+        {
+            plist::Data result(next() % 40);
+            for (auto& b : result) b = static_cast<std::byte>(next());
+            return result;
+        }
+
+        plist::ExternalData generateExternalData()
+        {
+            auto bytes = std::make_shared<plist::Data>(generateData());
+            if (next() & 1)
+                return plist::ExternalData{bytes->data(), bytes->size(), bytes};
+
+            return plist::ExternalData{bytes->size(), [bytes](const std::size_t offset, std::byte* buffer, const std::size_t count) {
+                std::copy_n(bytes->begin() + static_cast<std::ptrdiff_t>(offset), count, buffer);
+            }};
+        }
+
+        plist::Date generateDate() noexcept
+        {
+            // whole seconds between 1901 and 2038, sometimes with milliseconds
+            const auto seconds = std::chrono::seconds{static_cast<std::int32_t>(next(4))};
+            const auto milliseconds = std::chrono::milliseconds{next() % 4 == 0 ? next(2) % 1000 : 0};
+            return plist::Date{std::chrono::duration_cast<plist::Date::duration>(seconds + milliseconds)};
+        }
+
+        const std::uint8_t* data;
+        std::size_t size;
+        std::size_t position = 0;
+        std::size_t nodes = 0;
+    };
+
+    // the document of a seeded run of the standalone harness and of the tests
+    [[nodiscard]] inline plist::Value generate(const std::uint32_t seed, const std::size_t byteCount = 1024)
+    {
+        std::mt19937 random{seed};
+        std::vector<std::uint8_t> bytes(byteCount);
+        for (auto& b : bytes) b = static_cast<std::uint8_t>(random());
+        return Generator{bytes.data(), bytes.size()}.generate();
+    }
+
+    // decodes one code point, returns false on anything that is not well-formed UTF-8
+    inline bool decodeCodePoint(const std::string& s, std::size_t& i, char32_t& codePoint) noexcept
+    {
+        const auto byteAt = [&s](const std::size_t index) noexcept {
+            return static_cast<std::uint8_t>(s[index]);
+        };
+
+        const auto lead = byteAt(i);
+        std::size_t length;
+        char32_t minimum;
+        if (lead < 0x80) { codePoint = lead; ++i; return true; }
+        else if ((lead & 0xE0) == 0xC0) { length = 2; minimum = 0x80; codePoint = lead & 0x1F; }
+        else if ((lead & 0xF0) == 0xE0) { length = 3; minimum = 0x800; codePoint = lead & 0x0F; }
+        else if ((lead & 0xF8) == 0xF0) { length = 4; minimum = 0x10000; codePoint = lead & 0x07; }
+        else return false;
+
+        if (s.size() - i < length) return false;
+        for (std::size_t k = 1; k < length; ++k)
+        {
+            if ((byteAt(i + k) & 0xC0) != 0x80) return false;
+            codePoint = (codePoint << 6) | (byteAt(i + k) & 0x3F);
+        }
+
+        if (codePoint < minimum || codePoint > 0x10FFFF || (codePoint >= 0xD800 && codePoint <= 0xDFFF))
+            return false;
+
+        i += length;
+        return true;
+    }
+
+    inline std::vector<char32_t> decodeCodePoints(const std::string& s)
+    {
+        std::vector<char32_t> result;
+        for (std::size_t i = 0; i < s.size();)
+        {
+            char32_t codePoint;
+            if (!decodeCodePoint(s, i, codePoint))
+                throw std::runtime_error{"Invalid UTF-8"};
+            result.push_back(codePoint);
+        }
+        return result;
+    }
+
+    inline void appendCodePoint(const char32_t codePoint, std::string& result)
+    {
+        if (codePoint < 0x80)
+            result += static_cast<char>(codePoint);
+        else if (codePoint < 0x800)
+        {
+            result += static_cast<char>(0xC0 | (codePoint >> 6));
+            result += static_cast<char>(0x80 | (codePoint & 0x3F));
+        }
+        else if (codePoint < 0x10000)
+        {
+            result += static_cast<char>(0xE0 | (codePoint >> 12));
+            result += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+            result += static_cast<char>(0x80 | (codePoint & 0x3F));
+        }
+        else
+        {
+            result += static_cast<char>(0xF0 | (codePoint >> 18));
+            result += static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F));
+            result += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+            result += static_cast<char>(0x80 | (codePoint & 0x3F));
+        }
+    }
+
+    // \u or \U escapes of a code point, as UTF-16 surrogate pairs above the BMP
+    inline void appendEscaped(const char32_t codePoint, const char* prefix, std::string& result)
+    {
+        const auto append = [prefix, &result](const char32_t unit) {
+            char buffer[16];
+            std::snprintf(buffer, sizeof(buffer), "%s%04x", prefix, static_cast<unsigned>(unit));
+            result += buffer;
+        };
+
+        if (codePoint >= 0x10000)
+        {
+            append(0xD800 + ((codePoint - 0x10000) >> 10));
+            append(0xDC00 + ((codePoint - 0x10000) & 0x3FF));
+        }
+        else
+            append(codePoint);
+    }
+
+    inline std::vector<std::uint8_t> bytesOf(const plist::Value& value)
+    {
+        std::vector<std::uint8_t> result;
+        if (const auto data = value.getIf<plist::Data>())
+            for (const auto b : *data) result.push_back(static_cast<std::uint8_t>(b));
+        else if (const auto externalData = value.getIf<plist::ExternalData>())
+            externalData->read([&result](const std::byte* bytes, const std::size_t count) {
+                for (std::size_t i = 0; i < count; ++i) result.push_back(static_cast<std::uint8_t>(bytes[i]));
+            });
+        return result;
+    }
+
+    inline std::string base64(const std::vector<std::uint8_t>& bytes)
+    {
+        constexpr char characters[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+        std::string result;
+        for (std::size_t i = 0; i < bytes.size(); i += 3)
+        {
+            std::uint32_t group = static_cast<std::uint32_t>(bytes[i]) << 16;
+            if (i + 1 < bytes.size()) group |= static_cast<std::uint32_t>(bytes[i + 1]) << 8;
+            if (i + 2 < bytes.size()) group |= bytes[i + 2];
+            result += characters[(group >> 18) & 0x3F];
+            result += characters[(group >> 12) & 0x3F];
+            result += i + 1 < bytes.size() ? characters[(group >> 6) & 0x3F] : '=';
+            result += i + 2 < bytes.size() ? characters[group & 0x3F] : '=';
+        }
+        return result;
+    }
+
+    // ISO 8601 in UTC, counting the days year by year instead of with the civil calendar formulas
+    inline std::string isoDate(const plist::Date& date)
+    {
+        const auto seconds = std::chrono::floor<std::chrono::seconds>(date);
+        const auto fraction = std::chrono::duration_cast<std::chrono::nanoseconds>(date - seconds).count();
+        auto total = static_cast<long long>(seconds.time_since_epoch().count());
+        auto days = total >= 0 ? total / 86400 : (total - 86399) / 86400;
+        total -= days * 86400;
+
+        const auto isLeap = [](const long long y) noexcept {
+            return (y % 4 == 0 && y % 100 != 0) || y % 400 == 0;
+        };
+        long long year = 1970;
+        for (; days < 0; days += isLeap(year) ? 366 : 365) --year;
+        for (; days >= (isLeap(year) ? 366 : 365); ++year) days -= isLeap(year) ? 366 : 365;
+
+        const int monthLengths[] = {31, isLeap(year) ? 29 : 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+        int month = 0;
+        for (; days >= monthLengths[month]; ++month) days -= monthLengths[month];
+
+        char buffer[64];
+        std::snprintf(buffer, sizeof(buffer), "%04lld-%02d-%02lldT%02lld:%02lld:%02lld",
+                      year, month + 1, days + 1, total / 3600, total / 60 % 60, total % 60);
+        std::string result = buffer;
+        if (fraction)
+        {
+            std::snprintf(buffer, sizeof(buffer), ".%09lld", static_cast<long long>(fraction));
+            std::string digits = buffer;
+            result += digits.substr(0, digits.find_last_not_of('0') + 1);
+        }
+        return result + "Z";
+    }
+
+    // the shortest form that reads back as the same double, fixed notation unless scientific is shorter
+    inline std::string shortestReal(const double real)
+    {
+        char buffer[64];
+#if defined(__cpp_lib_to_chars)
+        for (int precision = 0;; ++precision)
+        {
+            std::snprintf(buffer, sizeof(buffer), "%.*e", precision, real);
+            if (std::strtod(buffer, nullptr) == real) break;
+        }
+
+        std::string text = buffer;
+        std::string sign;
+        if (text[0] == '-')
+        {
+            sign = "-";
+            text.erase(0, 1);
+        }
+
+        const auto e = text.find('e');
+        const auto exponent = std::atoi(text.c_str() + e + 1);
+        auto digits = text.substr(0, e);
+        digits.erase(std::remove(digits.begin(), digits.end(), '.'), digits.end());
+
+        auto scientific = digits.substr(0, 1);
+        if (digits.size() > 1) scientific += "." + digits.substr(1);
+        std::snprintf(buffer, sizeof(buffer), "e%c%02d", exponent < 0 ? '-' : '+', std::abs(exponent));
+        scientific += buffer;
+
+        std::string fixed;
+        if (exponent < 0)
+            fixed = "0." + std::string(static_cast<std::size_t>(-exponent - 1), '0') + digits;
+        else if (digits.size() <= static_cast<std::size_t>(exponent) + 1)
+        {
+            // integers are written with all of their digits instead of padding the shortest ones with zeros
+            std::snprintf(buffer, sizeof(buffer), "%.0f", std::fabs(real));
+            fixed = buffer;
+        }
+        else
+            fixed = digits.substr(0, static_cast<std::size_t>(exponent) + 1) + "." + digits.substr(static_cast<std::size_t>(exponent) + 1);
+
+        return sign + (fixed.size() <= scientific.size() ? fixed : scientific);
+#else
+        std::snprintf(buffer, sizeof(buffer), "%.17g", real);
+        return buffer;
+#endif
+    }
+
+    // Encodes one node at a time with plain string appends, without the encoders' fast paths.
+    class ReferenceEncoder final
+    {
+    public:
+        ReferenceEncoder(const plist::Format f, const plist::Options& o) noexcept: format{f}, options{o} {}
+
+        [[nodiscard]] std::string encode(const plist::Value& value)
+        {
+            result.clear();
+            if (format == plist::Format::text)
+                result += "// !$*UTF8*$!\n";
+            else if (format == plist::Format::xml)
+            {
+                result += "<?xml version=\"1.0\" encoding=\"UTF-8\"?>";
+                newLine();
+                result += "<!DOCTYPE plist PUBLIC \"-//Apple//DTD PLIST 1.0//EN\" \"http://www.apple.com/DTDs/PropertyList-1.0.dtd\">";
+                newLine();
+                result += "<plist version=\"1.0\">";
+                newLine();
+            }
+
+            encode(value, 0);
+
+            if (format == plist::Format::xml)
+            {
+                newLine();
+                result += "</plist>";
+            }
+            return result;
+        }
+
+    private:
+        void newLine()
+        {
+            if (options.whiteSpaces) result += '\n';
+        }
+
+        void indent(const std::size_t level)
+        {
+            if (options.whiteSpaces) result += std::string(level, '\t');
+        }
+
+        void encode(const plist::Value& value, const std::size_t level)
+        {
+            switch (format)
+            {
+                case plist::Format::text: return encodeText(value, level);
+                case plist::Format::xml: return encodeXml(value, level);
+                case plist::Format::json: return encodeJson(value, level);
+                default: throw std::runtime_error{"Unsupported format"};
+            }
+        }
+
+        void encodeText(const plist::Value& value, const std::size_t level)
+        {
+            if (const auto dictionary = value.getIf<plist::Dictionary>())
+            {
+                result += '{';
+                for (const auto& [key, member] : *dictionary)
+                {
+                    newLine();
+                    indent(level + 1);
+                    encodeTextString(key);
+                    result += options.whiteSpaces ? " = " : "=";
+                    encodeText(member, level + 1);
+                    result += ';';
+                }
+                newLine();
+                indent(level);
+                result += '}';
+            }
+            else if (const auto array = value.getIf<plist::Array>())
+            {
+                result += '(';
+                for (std::size_t i = 0; i < array->size(); ++i)
+                {
+                    if (i) result += ',';
+                    newLine();
+                    indent(level + 1);
+                    encodeText((*array)[i], level + 1);
+                }
+                newLine();
+                indent(level);
+                result += ')';
+            }
+            else if (value.is<plist::Data>() || value.is<plist::ExternalData>())
+            {
+                const auto bytes = bytesOf(value);
+                result += '<';
+                for (std::size_t i = 0; i < bytes.size(); ++i)
+                {
+                    char buffer[4];
+                    std::snprintf(buffer, sizeof(buffer), "%02X", bytes[i]);
+                    if (i && options.whiteSpaces) result += ' ';
+                    result += buffer;
+                }
+                result += '>';
+            }
+            else if (const auto string = value.getIf<plist::String>())
+                encodeTextString(*string);
+            else if (const auto real = value.getIf<double>())
+                result += formatFixed(*real);
+            else if (const auto integer = value.getIf<std::int64_t>())
+                result += std::to_string(*integer);
+            else if (const auto boolean = value.getIf<bool>())
+                result += *boolean ? "YES" : "NO";
+            else
+                throw std::runtime_error{"Date fields are not supported"};
+        }
+
+        void encodeTextString(const std::string& s)
+        {
+            const auto codePoints = decodeCodePoints(s);
+            if (s.empty())
+            {
+                result += "\"\"";
+                return;
+            }
+
+            const auto isPlain = [](const char c) noexcept {
+                return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+                    c == '_' || c == '$' || c == '/' || c == ':' || c == '.' || c == '-';
+            };
+            const bool quoted = !std::all_of(s.begin(), s.end(), isPlain);
+            const bool ascii = std::all_of(codePoints.begin(), codePoints.end(), [](const char32_t c) noexcept { return c < 0x80; });
+
+            if (quoted) result += '"';
+            for (const auto codePoint : codePoints)
+                if (codePoint >= 0x80 && options.escapeNonAscii && !ascii)
+                    appendEscaped(codePoint, "\\U", result);
+                else
+                {
+                    if (codePoint == '"' || codePoint == '\\') result += '\\';
+                    appendCodePoint(codePoint, result);
+                }
+            if (quoted) result += '"';
+        }
+
+        void encodeXml(const plist::Value& value, const std::size_t level)
+        {
+            if (const auto dictionary = value.getIf<plist::Dictionary>())
+            {
+                result += "<dict>";
+                newLine();
+                for (const auto& [key, member] : *dictionary)
+                {
+                    indent(level + 1);
+                    result += "<key>";
+                    encodeXmlString(key);
+                    result += "</key>";
+                    newLine();
+                    indent(level + 1);
+                    encodeXml(member, level + 1);
+                    newLine();
+                }
+                indent(level);
+                result += "</dict>";
+            }
+            else if (const auto array = value.getIf<plist::Array>())
+            {
+                result += "<array>";
+                newLine();
+                for (const auto& element : *array)
+                {
+                    indent(level + 1);
+                    encodeXml(element, level + 1);
+                    newLine();
+                }
+                indent(level);
+                result += "</array>";
+            }
+            else if (value.is<plist::Data>() || value.is<plist::ExternalData>())
+                result += "<data>" + base64(bytesOf(value)) + "</data>";
+            else if (const auto string = value.getIf<plist::String>())
+            {
+                result += "<string>";
+                encodeXmlString(*string);
+                result += "</string>";
+            }
+            else if (const auto real = value.getIf<double>())
+                result += "<real>" + formatFixed(*real) + "</real>";
+            else if (const auto integer = value.getIf<std::int64_t>())
+                result += "<integer>" + std::to_string(*integer) + "</integer>";
+            else if (const auto boolean = value.getIf<bool>())
+                result += *boolean ? "<true/>" : "<false/>";
+            else
+                throw std::runtime_error{"Date fields are not supported"};
+        }
+
+        void encodeXmlString(const std::string& s)
+        {
+            decodeCodePoints(s); // validates
+            for (const auto c : s)
+                if (c == '<') result += "&lt;";
+                else if (c == '>') result += "&gt;";
+                else if (c == '&') result += "&amp;";
+                else result += c;
+        }
+
+        void encodeJson(const plist::Value& value, const std::size_t level)
+        {
+            if (const auto dictionary = value.getIf<plist::Dictionary>())
+            {
+                result += '{';
+                std::size_t index = 0;
+                for (const auto& [key, member] : *dictionary)
+                {
+                    if (index++) result += ',';
+                    newLine();
+                    indent(level + 1);
+                    encodeJsonString(key);
+                    result += options.whiteSpaces ? ": " : ":";
+                    encodeJson(member, level + 1);
+                }
+                newLine();
+                indent(level);
+                result += '}';
+            }
+            else if (const auto array = value.getIf<plist::Array>())
+            {
+                result += '[';
+                for (std::size_t i = 0; i < array->size(); ++i)
+                {
+                    if (i) result += ',';
+                    newLine();
+                    indent(level + 1);
+                    encodeJson((*array)[i], level + 1);
+                }
+                newLine();
+                indent(level);
+                result += ']';
+            }
+            else if (value.is<plist::Data>() || value.is<plist::ExternalData>())
+                result += '"' + base64(bytesOf(value)) + '"';
+            else if (const auto string = value.getIf<plist::String>())
+                encodeJsonString(*string);
+            else if (const auto real = value.getIf<double>())
+            {
+                if (!std::isfinite(*real))
+                    throw std::runtime_error{"Non-finite numbers are not supported"};
+                const auto text = shortestReal(*real);
+                result += text;
+                if (text.find_first_of(".eE") == std::string::npos) result += ".0";
+            }
+            else if (const auto integer = value.getIf<std::int64_t>())
+                result += std::to_string(*integer);
+            else if (const auto boolean = value.getIf<bool>())
+                result += *boolean ? "true" : "false";
+            else if (const auto date = value.getIf<plist::Date>())
+                result += '"' + isoDate(*date) + '"';
+        }
+
+        void encodeJsonString(const std::string& s)
+        {
+            result += '"';
+            for (const auto codePoint : decodeCodePoints(s))
+                if (codePoint == '"' || codePoint == '\\')
+                {
+                    result += '\\';
+                    result += static_cast<char>(codePoint);
+                }
+                else if (codePoint == '\n') result += "\\n";
+                else if (codePoint == '\r') result += "\\r";
+                else if (codePoint == '\t') result += "\\t";
+                else if (codePoint < 0x20 || (codePoint >= 0x80 && options.escapeNonAscii))
+                    appendEscaped(codePoint, "\\u", result);
+                else
+                    appendCodePoint(codePoint, result);
+            result += '"';
+        }
+
+        static std::string formatFixed(const double real)
+        {
+            char buffer[512];
+            std::snprintf(buffer, sizeof(buffer), "%f", real);
+            return buffer;
+        }
+
+        plist::Format format;
+        plist::Options options;
+        std::string result;
+    };
+
+    // Reads the binary format straight from the specification, checking every offset.
+    class BinaryReader final
+    {
+    public:
+        explicit BinaryReader(const std::string& d) noexcept: data{d} {}
+
+        [[nodiscard]] plist::Value read()
+        {
+            if (data.size() < 8 + 32 || data.compare(0, 8, "bplist00") != 0)
+                throw Mismatch{"Invalid binary header"};
+
+            const auto trailer = data.size() - 32;
+            offsetSize = static_cast<std::uint8_t>(data[trailer + 6]);
+            referenceSize = static_cast<std::uint8_t>(data[trailer + 7]);
+            objectCount = readNumber(trailer + 8, 8);
+            const auto topObject = readNumber(trailer + 16, 8);
+            tableOffset = readNumber(trailer + 24, 8);
+
+            if (offsetSize == 0 || offsetSize > 8 || referenceSize == 0 || referenceSize > 8 ||
+                tableOffset > trailer || (trailer - tableOffset) != objectCount * offsetSize)
+                throw Mismatch{"Invalid binary trailer"};
+
+            return readObject(topObject, 0);
+        }
+
+    private:
+        std::uint64_t readNumber(const std::size_t offset, const std::size_t size) const
+        {
+            if (offset > data.size() || data.size() - offset < size)
+                throw Mismatch{"Binary object out of bounds"};
+
+            std::uint64_t result = 0;
+            for (std::size_t i = 0; i < size; ++i)
+                result = (result << 8) | static_cast<std::uint8_t>(data[offset + i]);
+            return result;
+        }
+
+        std::size_t readCount(const std::uint8_t marker, std::size_t& offset) const
+        {
+            if ((marker & 0x0F) != 0x0F) return marker & 0x0F;
+
+            const auto integerMarker = static_cast<std::uint8_t>(readNumber(offset, 1));
+            if ((integerMarker & 0xF0) != 0x10)
+                throw Mismatch{"Invalid binary count"};
+            const std::size_t size = std::size_t{1} << (integerMarker & 0x0F);
+            const auto count = readNumber(offset + 1, size);
+            offset += 1 + size;
+            if (count < 0x0F)
+                throw Mismatch{"Long binary count for a short object"};
+            return static_cast<std::size_t>(count);
+        }
+
+        plist::Value readObject(const std::uint64_t index, const std::size_t depth)
+        {
+            if (index >= objectCount || depth > 64)
+                throw Mismatch{"Invalid binary reference"};
+
+            auto offset = static_cast<std::size_t>(readNumber(static_cast<std::size_t>(tableOffset + index * offsetSize), offsetSize));
+            if (offset < 8 || offset >= tableOffset)
+                throw Mismatch{"Invalid binary offset"};
+
+            const auto marker = static_cast<std::uint8_t>(data[offset++]);
+            switch (marker >> 4)
+            {
+                case 0x0:
+                    if (marker == 0x08) return false;
+                    if (marker == 0x09) return true;
+                    break;
+                case 0x1:
+                {
+                    const std::size_t size = std::size_t{1} << (marker & 0x0F);
+                    if (size > 8) break;
+                    return static_cast<std::int64_t>(readNumber(offset, size));
+                }
+                case 0x2:
+                case 0x3:
+                {
+                    if ((marker & 0x0F) != 0x03) break;
+                    const auto bits = readNumber(offset, 8);
+                    double real;
+                    std::memcpy(&real, &bits, sizeof(real));
+                    if (marker == 0x23) return real;
+
+                    const std::chrono::duration<double> seconds{real + 978307200.0};
+                    return plist::Date{std::chrono::round<plist::Date::duration>(seconds)};
+                }
+                case 0x4:
+                {
+                    const auto size = readCount(marker, offset);
+                    if (offset > data.size() || data.size() - offset < size) break;
+                    plist::Data bytes(size);
+                    std::memcpy(bytes.data(), data.data() + offset, size);
+                    return bytes;
+                }
+                case 0x5:
+                {
+                    const auto size = readCount(marker, offset);
+                    if (offset > data.size() || data.size() - offset < size) break;
+                    return data.substr(offset, size);
+                }
+                case 0x6:
+                {
+                    const auto count = readCount(marker, offset);
+                    std::string result;
+                    for (std::size_t i = 0; i < count; ++i)
+                    {
+                        char32_t unit = static_cast<char32_t>(readNumber(offset + i * 2, 2));
+                        if (unit >= 0xD800 && unit <= 0xDBFF)
+                        {
+                            const auto low = static_cast<char32_t>(readNumber(offset + ++i * 2, 2));
+                            if (i == count || low < 0xDC00 || low > 0xDFFF)
+                                throw Mismatch{"Invalid UTF-16 surrogate pair"};
+                            unit = 0x10000 + ((unit - 0xD800) << 10) + (low - 0xDC00);
+                        }
+                        appendCodePoint(unit, result);
+                    }
+                    return result;
+                }
+                case 0xA:
+                {
+                    const auto count = readCount(marker, offset);
+                    plist::Array array;
+                    for (std::size_t i = 0; i < count; ++i)
+                        array.push_back(readObject(readNumber(offset + i * referenceSize, referenceSize), depth + 1));
+                    return array;
+                }
+                case 0xD:
+                {
+                    const auto count = readCount(marker, offset);
+                    plist::Dictionary dictionary;
+                    for (std::size_t i = 0; i < count; ++i)
+                    {
+                        const auto key = readObject(readNumber(offset + i * referenceSize, referenceSize), depth + 1);
+                        const auto member = readObject(readNumber(offset + (count + i) * referenceSize, referenceSize), depth + 1);
+                        if (!key.is<plist::String>() || !dictionary.try_emplace(key.as<plist::String>(), member).second)
+                            throw Mismatch{"Invalid binary dictionary key"};
+                    }
+                    return dictionary;
+                }
+                default:
+                    break;
+            }
+
+            throw Mismatch{"Invalid binary object"};
+        }
+
+        const std::string& data;
+        std::uint8_t offsetSize = 0;
+        std::uint8_t referenceSize = 0;
+        std::uint64_t objectCount = 0;
+        std::uint64_t tableOffset = 0;
+    };
+
+    // whether the decoded value matches the original, with external data read as data
+    // and dates allowed to move by the rounding of their binary representation
+    inline bool isEquivalent(const plist::Value& expected, const plist::Value& actual)
+    {
+        if (const auto dictionary = expected.getIf<plist::Dictionary>())
+        {
+            const auto other = actual.getIf<plist::Dictionary>();
+            if (!other || other->size() != dictionary->size()) return false;
+            for (const auto& [key, member] : *dictionary)
+            {
+                const auto i = other->find(key);
+                if (i == other->end() || !isEquivalent(member, i->second)) return false;
+            }
+            return true;
+        }
+        else if (const auto array = expected.getIf<plist::Array>())
+        {
+            const auto other = actual.getIf<plist::Array>();
+            if (!other || other->size() != array->size()) return false;
+            for (std::size_t i = 0; i < array->size(); ++i)
+                if (!isEquivalent((*array)[i], (*other)[i])) return false;
+            return true;
+        }
+        else if (expected.is<plist::Data>() || expected.is<plist::ExternalData>())
+            return (actual.is<plist::Data>() || actual.is<plist::ExternalData>()) && bytesOf(expected) == bytesOf(actual);
+        else if (const auto date = expected.getIf<plist::Date>())
+        {
+            const auto other = actual.getIf<plist::Date>();
+            return other && (*date > *other ? *date - *other : *other - *date) <= std::chrono::microseconds{2};
+        }
+        else
+            return expected == actual;
+    }
+
+    // what the JSON decoder produces for a value: data and dates become strings
+    inline plist::Value toJsonValue(const plist::Value& value)
+    {
+        if (const auto dictionary = value.getIf<plist::Dictionary>())
+        {
+            plist::Dictionary result;
+            for (const auto& [key, member] : *dictionary) result.try_emplace(key, toJsonValue(member));
+            return result;
+        }
+        else if (const auto array = value.getIf<plist::Array>())
+        {
+            plist::Array result;
+            for (const auto& element : *array) result.push_back(toJsonValue(element));
+            return result;
+        }
+        else if (value.is<plist::Data>() || value.is<plist::ExternalData>())
+            return base64(bytesOf(value));
+        else if (const auto date = value.getIf<plist::Date>())
+            return isoDate(*date);
+        else
+            return value;
+    }
+
+    inline std::string describe(const plist::Format format, const plist::Options& options)
+    {
+        std::string result = format == plist::Format::text ? "text" :
+            format == plist::Format::xml ? "xml" :
+            format == plist::Format::json ? "json" : "binary";
+        if (options.whiteSpaces) result += " pretty";
+        if (options.escapeNonAscii) result += " escaped";
+        if (format == plist::Format::binary)
+            result += options.uniquing == plist::Uniquing::none ? " unique none" :
+                options.uniquing == plist::Uniquing::leaves ? " unique leaves" : " unique all";
+        return result;
+    }
+
+    // Checks every format and option of one document. It keeps reusable encoders between documents,
+    // so that state leaking from one document into the next is caught as well.
+    class Checker final
+    {
+    public:
+        void check(const plist::Value& value)
+        {
+            for (const auto format : {plist::Format::text, plist::Format::xml, plist::Format::json})
+                for (const bool whiteSpaces : {false, true})
+                    for (const bool escapeNonAscii : {false, true})
+                    {
+                        plist::Options options;
+                        options.whiteSpaces = whiteSpaces;
+                        options.escapeNonAscii = escapeNonAscii;
+                        checkTextual(value, format, options);
+                    }
+
+            std::size_t previousSize = std::numeric_limits<std::size_t>::max();
+            for (const auto uniquing : {plist::Uniquing::none, plist::Uniquing::leaves, plist::Uniquing::all})
+            {
+                plist::Options options;
+                options.uniquing = uniquing;
+                const auto size = checkBinary(value, options);
+                if (size > previousSize)
+                    throw Mismatch{describe(plist::Format::binary, options) + ": uniquing made the document larger"};
+                previousSize = size;
+            }
+        }
+
+        // decodes arbitrary bytes, and whatever the decoder accepts must survive encoding and decoding again
+        void checkDecoding(const std::string_view data)
+        {
+            plist::Value decoded;
+            std::string encoded;
+            try
+            {
+                decoded = plist::decode(data, plist::Format::json);
+                encoded = plist::encode(decoded, plist::Format::json);
+            }
+            catch (const std::runtime_error&)
+            {
+                return; // not JSON, or not representable in it
+            }
+
+            if (!isEquivalent(decoded, plist::decode(encoded, plist::Format::json)))
+                throw Mismatch{"json: decoding the encoded document changed it"};
+        }
+
+    private:
+        void checkTextual(const plist::Value& value, const plist::Format format, const plist::Options& options)
+        {
+            const auto name = describe(format, options);
+
+            std::string expected;
+            bool expectedError = false;
+            try
+            {
+                expected = ReferenceEncoder{format, options}.encode(value);
+            }
+            catch (const std::runtime_error&)
+            {
+                expectedError = true;
+            }
+
+            std::string actual;
+            bool actualError = false;
+            try
+            {
+                actual = plist::encode(value, format, options);
+            }
+            catch (const std::runtime_error&)
+            {
+                actualError = true;
+            }
+
+            if (expectedError != actualError)
+                throw Mismatch{name + (expectedError ? ": encoded an invalid document" : ": failed to encode a valid document")};
+            if (expectedError) return;
+            if (actual != expected)
+                throw Mismatch{name + ": output differs from the reference\nexpected: " + expected + "\nactual:   " + actual};
+
+            // the chunked encoder must produce the same bytes for any chunk size
+            plist::ChunkedEncoder chunked{value, format, options};
+            std::string chunks;
+            const auto chunkSize = 1 + actual.size() % 61;
+            while (!chunked.isDone()) chunks += chunked.next(chunkSize);
+            if (chunks != actual)
+                throw Mismatch{name + ": chunked output differs"};
+
+            if (format == plist::Format::json &&
+                !isEquivalent(toJsonValue(value), plist::decode(actual, plist::Format::json)))
+                throw Mismatch{name + ": decoded document differs"};
+        }
+
+        std::size_t checkBinary(const plist::Value& value, const plist::Options& options)
+        {
+            const auto name = describe(plist::Format::binary, options);
+
+            bool valid = true;
+            forEachString(value, [&valid](const std::string& s) {
+                std::size_t i = 0;
+                char32_t codePoint;
+                while (valid && i < s.size()) valid = decodeCodePoint(s, i, codePoint);
+            });
+
+            auto& encoder = binaryEncoders[static_cast<std::size_t>(options.uniquing)];
+            std::string actual;
+            try
+            {
+                actual = plist::encode(value, plist::Format::binary, options);
+                if (encoder.encode(value) != actual)
+                    throw Mismatch{name + ": reused encoder output differs"};
+            }
+            catch (const std::runtime_error&)
+            {
+                if (valid) throw Mismatch{name + ": failed to encode a valid document"};
+                return 0;
+            }
+
+            if (!valid) throw Mismatch{name + ": encoded an invalid document"};
+            if (!isEquivalent(value, BinaryReader{actual}.read()))
+                throw Mismatch{name + ": decoded document differs"};
+            return actual.size();
+        }
+
+        template <typename F>
+        static void forEachString(const plist::Value& value, F&& f)
+        {
+            if (const auto dictionary = value.getIf<plist::Dictionary>())
+                for (const auto& [key, member] : *dictionary)
+                {
+                    f(key);
+                    forEachString(member, f);
+                }
+            else if (const auto array = value.getIf<plist::Array>())
+                for (const auto& element : *array) forEachString(element, f);
+            else if (const auto string = value.getIf<plist::String>())
+                f(*string);
+        }
+
+        plist::Encoder binaryEncoders[3] = {
+            plist::Encoder{plist::Format::binary, plist::Options{false, plist::Uniquing::none}},
+            plist::Encoder{plist::Format::binary, plist::Options{false, plist::Uniquing::leaves}},
+            plist::Encoder{plist::Format::binary, plist::Options{false, plist::Uniquing::all}}
+        };
+    };
+}
+
+#endif // PLIST_ROUNDTRIP_HPP
@@ -1,8 +1,16 @@
+#include <algorithm>
+#include <chrono>
 #include <cstddef>
+#include <cstring>
+#include <limits>
+#include <map>
 #include <string>
 #include <vector>
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
 #include "catch2/catch.hpp"
 #include "plist.hpp"
+#include "legacy.hpp"
+#include "roundtrip.hpp"
 
 TEST_CASE("Bool constructor", "[constructors]")
 {
@@ -418,3 +426,1115 @@ TEST_CASE("Dictionary encoding", "[encoding]")
                 "</plist>");
     }
 }
+
+TEST_CASE("Diff of equal values", "[diff]")
+{
+    const plist::Value a = plist::Dictionary{{"a", 1}, {"b", plist::Array{1, 2}}};
+    const plist::Value b = a;
+    REQUIRE(plist::diff(a, b).empty());
+}
+
+TEST_CASE("Diff of dictionaries", "[diff]")
+{
+    const plist::Value a = plist::Dictionary{{"a", 1}, {"b", 2}, {"c", plist::Dictionary{{"d", "e"}}}};
+    const plist::Value b = plist::Dictionary{{"b", 2}, {"c", plist::Dictionary{{"d", "f"}}}, {"g", true}};
+    const auto patch = plist::diff(a, b);
+
+    REQUIRE(patch.size() == 3);
+    REQUIRE(patch[0].operation == plist::Operation::remove);
+    REQUIRE(patch[0].path == std::vector<plist::PathElement>{std::string{"a"}});
+    REQUIRE(patch[1].operation == plist::Operation::set);
+    REQUIRE(patch[1].path == std::vector<plist::PathElement>{std::string{"c"}, std::string{"d"}});
+    REQUIRE(patch[1].value.as<std::string>() == "f");
+    REQUIRE(patch[2].operation == plist::Operation::set);
+    REQUIRE(patch[2].path == std::vector<plist::PathElement>{std::string{"g"}});
+
+    plist::Value c = a;
+    plist::apply(c, patch);
+    REQUIRE(plist::diff(c, b).empty());
+}
+
+TEST_CASE("Diff of arrays", "[diff]")
+{
+    const plist::Value a = plist::Array{1, 2, 3, 4};
+
+    SECTION("insertion")
+    {
+        const plist::Value b = plist::Array{0, 1, 2, 3, 4};
+        const auto patch = plist::diff(a, b);
+        REQUIRE(patch.size() == 1);
+        REQUIRE(patch[0].operation == plist::Operation::insert);
+        REQUIRE(patch[0].path == std::vector<plist::PathElement>{std::size_t{0}});
+
+        plist::Value c = a;
+        plist::apply(c, patch);
+        REQUIRE(plist::diff(c, b).empty());
+    }
+
+    SECTION("removal")
+    {
+        const plist::Value b = plist::Array{1, 4};
+        const auto patch = plist::diff(a, b);
+        REQUIRE(patch.size() == 2);
+        REQUIRE(patch[0].operation == plist::Operation::remove);
+        REQUIRE(patch[1].operation == plist::Operation::remove);
+
+        plist::Value c = a;
+        plist::apply(c, patch);
+        REQUIRE(plist::diff(c, b).empty());
+    }
+
+    SECTION("type change")
+    {
+        const plist::Value b = "a";
+        const auto patch = plist::diff(a, b);
+        REQUIRE(patch.size() == 1);
+        REQUIRE(patch[0].path.empty());
+
+        plist::Value c = a;
+        plist::apply(c, patch);
+        REQUIRE(c.as<std::string>() == "a");
+    }
+}
+
+TEST_CASE("Patch encoding", "[diff]")
+{
+    const plist::Value a = plist::Dictionary{{"a", plist::Array{1, 2}}, {"b", 2}};
+    const plist::Value b = plist::Dictionary{{"a", plist::Array{1, 3, 4}}};
+    const auto patch = plist::toPatch(plist::toValue(plist::diff(a, b)));
+
+    REQUIRE(plist::encode(plist::toValue(patch), plist::Format::text) ==
+            "// !$*UTF8*$!\n("
+            "{op=set;path=(a,1);value=3;},"
+            "{op=insert;path=(a,2);value=4;},"
+            "{op=remove;path=(b);})");
+
+    plist::Value c = a;
+    plist::apply(c, patch);
+    REQUIRE(plist::diff(c, b).empty());
+}
+
+TEST_CASE("Equality", "[comparison]")
+{
+    const plist::Value a = plist::Dictionary{{"a", plist::Array{1, 2.0, "3"}}, {"b", true}};
+    plist::Value b = a;
+    REQUIRE(a == b);
+
+    b["a"][2] = "4";
+    REQUIRE(a != b);
+    REQUIRE(plist::Value{1} != plist::Value{1.0});
+    REQUIRE(plist::Value{plist::Array{}} != plist::Value{plist::Dictionary{}});
+}
+
+TEST_CASE("Hash", "[comparison]")
+{
+    const plist::Value a = plist::Dictionary{{"a", plist::Array{1, 2.0, "3"}}, {"b", plist::Data{std::byte{1U}}}};
+    plist::Value b = a;
+    REQUIRE(plist::hash(a) == plist::hash(b));
+    REQUIRE(plist::hash(a, 1) != plist::hash(a, 2));
+    REQUIRE(plist::hash(plist::Value{0.0}) == plist::hash(plist::Value{-0.0}));
+    REQUIRE(plist::hash(plist::Value{1}) != plist::hash(plist::Value{true}));
+    REQUIRE(plist::hash(plist::Value{"abcdefghijklmnopq"}) != plist::hash(plist::Value{"abcdefghijklmnopr"}));
+
+    b["a"][0] = 2;
+    REQUIRE(plist::hash(a) != plist::hash(b));
+
+    plist::HashCache cache;
+    REQUIRE(cache.hash(a) == plist::hash(a));
+    REQUIRE(!cache.equal(a, b));
+    REQUIRE(cache.equal(a, a));
+
+    // a modified copy shares the unchanged subtrees with the original
+    plist::Array items;
+    for (int i = 0; i < 100; ++i)
+    {
+        plist::Value item;
+        item["index"] = i;
+        item["tags"] = plist::Array{"x", "y"};
+        items.push_back(item);
+    }
+    const plist::Value tree = plist::Dictionary{{"items", items}, {"name", "tree"}};
+    auto modified = tree;
+    modified["items"][50]["index"] = -1;
+    const plist::Value rebuilt = plist::Dictionary{{"name", "tree"}, {"items", items}};
+
+    plist::HashCache seeded{42};
+    REQUIRE(seeded.hash(tree) == plist::hash(tree, 42));
+    REQUIRE(seeded.hash(modified) == plist::hash(modified, 42));
+    REQUIRE(seeded.hash(rebuilt) == seeded.hash(tree));
+    REQUIRE_FALSE(seeded.equal(tree, modified));
+    REQUIRE(seeded.equal(tree, rebuilt));
+    REQUIRE(seeded.equal(tree, plist::Value{tree}));
+    REQUIRE_FALSE(seeded.equal(plist::Value{plist::Array{}}, plist::Value{plist::Dictionary{}}));
+}
+
+TEST_CASE("Binary encoding", "[encoding]")
+{
+    const plist::Value v = plist::Array{"a", "a"};
+
+    SECTION("unique objects")
+    {
+        const auto result = plist::encode(v, plist::Format::binary);
+        REQUIRE(result == std::string{"bplist00"
+                "\x51\x61\xA2\x00\x00"
+                "\x08\x0A"
+                "\x00\x00\x00\x00\x00\x00\x01\x01"
+                "\x00\x00\x00\x00\x00\x00\x00\x02"
+                "\x00\x00\x00\x00\x00\x00\x00\x01"
+                "\x00\x00\x00\x00\x00\x00\x00\x0D", 47});
+    }
+
+    SECTION("without uniquing")
+    {
+        plist::Options options;
+        options.uniquing = plist::Uniquing::none;
+        const auto result = plist::encode(v, plist::Format::binary, options);
+        REQUIRE(result == std::string{"bplist00"
+                "\x51\x61\x51\x61\xA2\x00\x01"
+                "\x08\x0A\x0C"
+                "\x00\x00\x00\x00\x00\x00\x01\x01"
+                "\x00\x00\x00\x00\x00\x00\x00\x03"
+                "\x00\x00\x00\x00\x00\x00\x00\x02"
+                "\x00\x00\x00\x00\x00\x00\x00\x0F", 50});
+    }
+}
+
+TEST_CASE("Binary encoding uniquing", "[encoding]")
+{
+    const plist::Value entry = plist::Dictionary{{"name", "value"}, {"count", 1}};
+    const plist::Value v = plist::Array{entry, entry, entry};
+
+    plist::Options options;
+    options.uniquing = plist::Uniquing::none;
+    const auto none = plist::encode(v, plist::Format::binary, options);
+    options.uniquing = plist::Uniquing::leaves;
+    const auto leaves = plist::encode(v, plist::Format::binary, options);
+    options.uniquing = plist::Uniquing::all;
+    const auto all = plist::encode(v, plist::Format::binary, options);
+
+    REQUIRE(leaves.size() < none.size());
+    REQUIRE(all.size() < leaves.size());
+    REQUIRE(all.compare(all.size() - 24, 8, std::string(7, '\0') + '\x06') == 0); // 4 leaves, 1 dictionary and 1 array
+}
+
+TEST_CASE("Copy on write", "[cow]")
+{
+    plist::Value original = plist::Dictionary{
+        {"a", plist::Array{1, 2}},
+        {"b", plist::Dictionary{{"c", 3}}}
+    };
+    const plist::Value& constOriginal = original;
+    const plist::Value snapshot = original;
+
+    REQUIRE(snapshot.getIf<plist::Dictionary>() == constOriginal.getIf<plist::Dictionary>());
+
+    original["a"][0] = 0;
+    REQUIRE(snapshot["a"][0].as<std::int64_t>() == 1);
+    REQUIRE(original["a"][0].as<std::int64_t>() == 0);
+
+    // only the mutated path is cloned
+    REQUIRE(snapshot.getIf<plist::Dictionary>() != constOriginal.getIf<plist::Dictionary>());
+    REQUIRE(snapshot["a"].getIf<plist::Array>() != constOriginal["a"].getIf<plist::Array>());
+    REQUIRE(snapshot["b"].getIf<plist::Dictionary>() == constOriginal["b"].getIf<plist::Dictionary>());
+
+    const auto patch = plist::diff(snapshot, original);
+    REQUIRE(patch.size() == 1);
+}
+
+TEST_CASE("Freeze", "[frozen]")
+{
+    const auto date = std::chrono::system_clock::time_point{std::chrono::seconds{1000}};
+    const plist::Value v = plist::Dictionary{
+        {"array", plist::Array{1, 2.5, true}},
+        {"data", plist::Data{std::byte{1U}, std::byte{2U}}},
+        {"date", date},
+        {"string", "test"},
+        {"empty", plist::Dictionary{}}
+    };
+
+    const auto frozen = plist::freeze(v);
+    const auto root = frozen.getRoot();
+
+    REQUIRE(root.is<plist::Dictionary>());
+    REQUIRE(root.getSize() == 5);
+    REQUIRE(root.hasMember("array"));
+    REQUIRE(!root.hasMember("missing"));
+    REQUIRE(root["array"].getSize() == 3);
+    REQUIRE(root["array"][0].as<std::int64_t>() == 1);
+    REQUIRE(root["array"][1].as<double>() == 2.5);
+    REQUIRE(root["array"][2].as<bool>());
+    REQUIRE(root["data"].as<plist::Data>() == v["data"].as<plist::Data>());
+    REQUIRE(root["date"].as<plist::Date>() == date);
+    REQUIRE(root["string"].as<std::string_view>() == "test");
+    REQUIRE(std::string{root["string"].as<const char*>()} == "test");
+    REQUIRE(root["empty"].isEmpty());
+    REQUIRE_THROWS_AS(root["missing"], plist::RangeError);
+    REQUIRE_THROWS_AS(root["string"][0], plist::TypeError);
+
+    std::size_t counter = 1;
+    for (const auto e : root["array"])
+        if (e.is<std::int64_t>()) REQUIRE(e.as<std::size_t>() == counter++);
+
+    REQUIRE(plist::toValue(root) == v);
+}
+
+TEST_CASE("Frozen relocation", "[frozen]")
+{
+    const plist::Value v = plist::Array{"a", plist::Dictionary{{"b", 1}}};
+    const auto frozen = plist::freeze(v);
+
+    std::vector<std::uint64_t> copy(frozen.getSize() / sizeof(std::uint64_t));
+    std::memcpy(copy.data(), frozen.getData(), frozen.getSize());
+
+    const auto root = plist::FrozenValue::open(copy.data(), frozen.getSize());
+    REQUIRE(plist::toValue(root) == v);
+
+    // the payload offsets of the root array, of "a" and the characters of "a"
+    const auto corrupted = [&copy, &frozen](const std::size_t word, const std::uint64_t value) {
+        auto block = copy;
+        block[word] = value;
+        return plist::FrozenValue::open(block.data(), frozen.getSize());
+    };
+    REQUIRE_THROWS(corrupted(3, 16)); // children before their parent
+    REQUIRE_THROWS(corrupted(3, frozen.getSize())); // children out of the block
+    REQUIRE_THROWS(corrupted(5, std::uint64_t{1} << 40)); // characters out of the block
+    REQUIRE_THROWS(corrupted(8, ~std::uint64_t{0})); // no terminator
+    REQUIRE_NOTHROW(plist::FrozenValue::openUnchecked(copy.data(), frozen.getSize()));
+
+    copy[0] = 0;
+    REQUIRE_THROWS(plist::FrozenValue::open(copy.data(), frozen.getSize()));
+}
+
+TEST_CASE("External data encoding", "[encoding]")
+{
+    const std::vector<std::byte> bytes{std::byte{0U}, std::byte{1U}, std::byte{2U}, std::byte{3U}};
+    const plist::Value data = plist::Data{bytes};
+
+    SECTION("borrowed bytes")
+    {
+        const auto owner = std::make_shared<std::vector<std::byte>>(bytes);
+        const plist::Value v = plist::ExternalData{owner->data(), owner->size(), owner};
+        REQUIRE(v.is<plist::ExternalData>());
+        REQUIRE(plist::encode(v, plist::Format::text, true) == plist::encode(data, plist::Format::text, true));
+        REQUIRE(plist::encode(v, plist::Format::xml) == plist::encode(data, plist::Format::xml));
+        REQUIRE(plist::encode(v, plist::Format::binary) == plist::encode(data, plist::Format::binary));
+    }
+
+    SECTION("reader")
+    {
+        // larger than a chunk, so that base64 groups span chunk boundaries
+        std::vector<std::byte> large(plist::ExternalData::chunkSize * 2 + 1);
+        for (std::size_t i = 0; i < large.size(); ++i)
+            large[i] = static_cast<std::byte>(i * 7);
+
+        std::size_t reads = 0;
+        const plist::Value v = plist::ExternalData{large.size(), [&large, &reads](std::size_t offset, std::byte* buffer, std::size_t size) {
+            ++reads;
+            std::memcpy(buffer, large.data() + offset, size);
+        }};
+        const plist::Value copy = plist::Data{large};
+
+        REQUIRE(plist::encode(v, plist::Format::xml) == plist::encode(copy, plist::Format::xml));
+        REQUIRE(reads == 3);
+        REQUIRE(plist::encode(v, plist::Format::binary) == plist::encode(copy, plist::Format::binary));
+        REQUIRE(plist::toValue(plist::freeze(v).getRoot()) == copy);
+        REQUIRE(v == v);
+    }
+}
+
+TEST_CASE("Chunked encoding", "[encoding]")
+{
+    plist::Value v = plist::Dictionary{
+        {"array", plist::Array{1, "two", plist::Dictionary{{"three", 3.0}}}},
+        {"data", plist::Data(100, std::byte{0xAB})},
+        {"empty", plist::Array{}},
+        {"string", "a b"}
+    };
+
+    for (const auto format : {plist::Format::text, plist::Format::xml, plist::Format::binary, plist::Format::json})
+        for (const auto whiteSpaces : {false, true})
+            for (const std::size_t chunkSize : {1, 7, 4096})
+            {
+                plist::ChunkedEncoder encoder{v, format, whiteSpaces};
+                std::string result;
+                while (!encoder.isDone())
+                {
+                    const auto chunk = encoder.next(chunkSize);
+                    REQUIRE(!chunk.empty());
+                    REQUIRE(chunk.size() <= chunkSize);
+                    result += chunk;
+                }
+                REQUIRE(encoder.next(chunkSize).empty());
+                REQUIRE(result == plist::encode(v, format, whiteSpaces));
+            }
+
+    SECTION("snapshot")
+    {
+        plist::ChunkedEncoder encoder{v, plist::Format::text};
+        const auto expected = plist::encode(v, plist::Format::text);
+        v["string"] = "changed";
+
+        std::string result;
+        while (!encoder.isDone())
+            result += encoder.next(16);
+        REQUIRE(result == expected);
+    }
+
+    SECTION("zero chunk size")
+    {
+        plist::ChunkedEncoder encoder{v, plist::Format::json};
+        REQUIRE_THROWS_AS(encoder.next(0), std::invalid_argument);
+    }
+
+    SECTION("large leaf")
+    {
+        const plist::Value large = plist::Array{std::string(100000, 'a'), 1};
+        for (const auto format : {plist::Format::json, plist::Format::binary})
+        {
+            plist::ChunkedEncoder encoder{large, format};
+            std::string result;
+            std::size_t largest = 0;
+            while (!encoder.isDone())
+            {
+                const auto chunk = encoder.next(10);
+                largest = std::max(largest, chunk.size());
+                result += chunk;
+            }
+            REQUIRE(largest == 10);
+            REQUIRE(result == plist::encode(large, format));
+        }
+    }
+}
+
+TEST_CASE("Nested dictionary encoding", "[encoding]")
+{
+    const plist::Value v = plist::Array{plist::Dictionary{{"a", 1}}};
+    const auto result = plist::encode(v, plist::Format::xml);
+    REQUIRE(result == "<?xml version=\"1.0\" encoding=\"UTF-8\"?>"
+            "<!DOCTYPE plist PUBLIC \"-//Apple//DTD PLIST 1.0//EN\" \"http://www.apple.com/DTDs/PropertyList-1.0.dtd\">"
+            "<plist version=\"1.0\"><array><dict><key>a</key><integer>1</integer></dict></array></plist>");
+}
+
+TEST_CASE("Encoder reuse", "[encoding]")
+{
+    std::vector<plist::Value> values;
+    for (int i = 0; i < 100; ++i)
+    {
+        plist::Array strings;
+        for (int j = 0; j < i; ++j) strings.push_back(std::to_string(j % 50));
+        values.push_back(plist::Dictionary{{"index", i}, {"strings", strings}});
+    }
+
+    for (const auto format : {plist::Format::text, plist::Format::xml, plist::Format::binary})
+    {
+        plist::Encoder encoder{format};
+        for (const auto& v : values)
+            REQUIRE(encoder.encode(v) == plist::encode(v, format));
+
+        plist::Batch batch;
+        encoder.encode(values.begin(), values.end(), batch);
+        REQUIRE(batch.size() == values.size());
+        for (std::size_t i = 0; i < values.size(); ++i)
+            REQUIRE(batch[i] == plist::encode(values[i], format));
+    }
+
+    std::string result = "prefix";
+    plist::encodeInto(result, values[1], plist::Format::text);
+    REQUIRE(result == "prefix" + plist::encode(values[1], plist::Format::text));
+}
+
+TEST_CASE("UTF-8 validation", "[encoding]")
+{
+    for (const auto invalid : {"\xC0\xAF", "\xED\xA0\x80", "\xF5\x80\x80\x80", "\xE2\x82", "abcdefghijklmnopqrstuvwxyz\xFF"})
+    {
+        const plist::Value v = invalid;
+        REQUIRE_THROWS_AS(plist::encode(v, plist::Format::text), std::runtime_error);
+        REQUIRE_THROWS_AS(plist::encode(v, plist::Format::xml), std::runtime_error);
+        REQUIRE_THROWS_AS(plist::encode(v, plist::Format::binary), std::runtime_error);
+    }
+}
+
+TEST_CASE("Non-ASCII string encoding", "[encoding]")
+{
+    const std::string ascii(40, 'a');
+    const plist::Value v = ascii + "\xC3\xA9\xF0\x9F\x98\x80"; // U+00E9 and U+1F600
+
+    SECTION("text")
+    {
+        REQUIRE(plist::encode(v, plist::Format::text) == "// !$*UTF8*$!\n\"" + ascii + "\xC3\xA9\xF0\x9F\x98\x80\"");
+
+        plist::Options options;
+        options.escapeNonAscii = true;
+        REQUIRE(plist::encode(v, plist::Format::text, options) == "// !$*UTF8*$!\n\"" + ascii + "\\U00e9\\Ud83d\\Ude00\"");
+    }
+
+    SECTION("binary")
+    {
+        std::string expected = "\x6F\x10\x2B"; // 43 UTF-16 code units
+        for (std::size_t i = 0; i < ascii.size(); ++i) expected += std::string{"\0a", 2};
+        expected += std::string{"\x00\xE9\xD8\x3D\xDE\x00", 6};
+
+        const auto result = plist::encode(v, plist::Format::binary);
+        REQUIRE(result.compare(8, expected.size(), expected) == 0);
+    }
+}
+
+TEST_CASE("JSON encoding", "[json]")
+{
+    const plist::Value v = plist::Dictionary{
+        {"array", plist::Array{1, 2.5, 3.0, true}},
+        {"data", plist::Data{std::byte{0x01}, std::byte{0x02}, std::byte{0x03}, std::byte{0x04}}},
+        {"date", plist::Date{std::chrono::seconds{978307200} + std::chrono::milliseconds{250}}},
+        {"empty", plist::Dictionary{}},
+        {"string", "a \"b\"\\\n\x01"}
+    };
+
+    SECTION("compact")
+    {
+        REQUIRE(plist::encode(v, plist::Format::json) ==
+                "{\"array\":[1,2.5,3.0,true],"
+                "\"data\":\"AQIDBA==\","
+                "\"date\":\"2001-01-01T00:00:00.25Z\","
+                "\"empty\":{},"
+                "\"string\":\"a \\\"b\\\"\\\\\\n\\u0001\"}");
+    }
+
+    SECTION("with white spaces")
+    {
+        const plist::Value array = plist::Array{1, plist::Dictionary{{"a", false}}};
+        REQUIRE(plist::encode(array, plist::Format::json, true) == "[\n\t1,\n\t{\n\t\t\"a\": false\n\t}\n]");
+    }
+
+    SECTION("escaped non-ASCII")
+    {
+        plist::Options options;
+        options.escapeNonAscii = true;
+        REQUIRE(plist::encode(plist::Value{"\xC3\xA9\xF0\x9F\x98\x80"}, plist::Format::json, options) == "\"\\u00e9\\ud83d\\ude00\"");
+        REQUIRE(plist::encode(plist::Value{"\xC3\xA9"}, plist::Format::json) == "\"\xC3\xA9\"");
+    }
+
+    SECTION("non-finite numbers")
+    {
+        REQUIRE_THROWS_AS(plist::encode(plist::Value{std::numeric_limits<double>::infinity()}, plist::Format::json), std::runtime_error);
+    }
+}
+
+TEST_CASE("JSON decoding", "[json]")
+{
+    SECTION("round trip")
+    {
+        const plist::Value v = plist::Dictionary{
+            {"array", plist::Array{-1, 0.1, 1e300, 9223372036854775807LL, false}},
+            {"dictionary", plist::Dictionary{{"", plist::Array{}}, {"nested", plist::Dictionary{}}}},
+            {"string", std::string{"tab\t quote\" \xE2\x82\xAC \xF0\x9F\x98\x80 control\x1F"} + std::string(40, 'x')}
+        };
+
+        for (const auto whiteSpaces : {false, true})
+            REQUIRE(plist::decode(plist::encode(v, plist::Format::json, whiteSpaces), plist::Format::json) == v);
+    }
+
+    SECTION("escapes and numbers")
+    {
+        const auto v = plist::decode(" [\"\\u00e9\\ud83d\\ude00\\/\", 18446744073709551616, -0.5e1, 1E2 ] ", plist::Format::json);
+        REQUIRE(v[0].as<std::string>() == "\xC3\xA9\xF0\x9F\x98\x80/");
+        REQUIRE(v[1].as<double>() == 18446744073709551616.0);
+        REQUIRE(v[2].as<double>() == -5.0);
+        REQUIRE(v[3].as<double>() == 100.0);
+    }
+
+    SECTION("errors")
+    {
+        for (const auto invalid : {"", "[1,]", "{\"a\" 1}", "[1] 2", "01", "1.", "\"\\ud800\"",
+                                   "\"\\x\"", "\"a\nb\"", "\"\xC3\"", "null", "tru", "1e999"})
+            REQUIRE_THROWS_AS(plist::decode(invalid, plist::Format::json), plist::ParseError);
+
+        REQUIRE_THROWS_AS(plist::decode("{}", plist::Format::xml), std::runtime_error);
+    }
+}
+
+TEST_CASE("Path", "[path]")
+{
+    const plist::Value v = plist::Dictionary{
+        {"targets", plist::Array{
+            plist::Dictionary{{"buildSettings", plist::Dictionary{{"SDKROOT", "iphoneos"}}}},
+            plist::Dictionary{{"name", "no settings"}},
+            plist::Dictionary{{"buildSettings", plist::Dictionary{{"SDKROOT", "macosx"}}}}
+        }},
+        {"a/b", plist::Dictionary{{"~", 1}, {"0", 2}}}
+    };
+
+    SECTION("find")
+    {
+        REQUIRE(plist::Path{""}.find(v) == &v);
+        REQUIRE(plist::Path{"/targets/2/buildSettings/SDKROOT"}.find(v)->as<std::string>() == "macosx");
+        REQUIRE(plist::Path{"/targets/*/buildSettings/SDKROOT"}.find(v)->as<std::string>() == "iphoneos");
+        REQUIRE(plist::Path{"/a~1b/~0"}.find(v)->as<int>() == 1);
+        REQUIRE(plist::Path{"/a~1b/0"}.find(v)->as<int>() == 2);
+        REQUIRE(plist::Path{"/targets/3"}.find(v) == nullptr);
+        REQUIRE(plist::Path{"/targets/01"}.find(v) == nullptr);
+        REQUIRE(plist::Path{"/targets/name"}.find(v) == nullptr);
+        REQUIRE(plist::Path{"/missing/*"}.find(v) == nullptr);
+    }
+
+    SECTION("select")
+    {
+        const plist::Path path{"/targets/*/buildSettings/SDKROOT"};
+        std::vector<const plist::Value*> matches;
+        path.select(v, matches);
+        REQUIRE(matches.size() == 2);
+        REQUIRE(matches[0]->as<std::string>() == "iphoneos");
+        REQUIRE(matches[1]->as<std::string>() == "macosx");
+
+        std::size_t count = 0;
+        plist::Path{"/*/*"}.forEach(v, [&count](const plist::Value&) { ++count; });
+        REQUIRE(count == 5);
+    }
+
+    SECTION("invalid")
+    {
+        REQUIRE_THROWS_AS(plist::Path{"targets"}, plist::ParseError);
+        REQUIRE_THROWS_AS(plist::Path{"/a~2"}, plist::ParseError);
+    }
+}
+
+TEST_CASE("Encoding styles", "[encoding]")
+{
+    const plist::Value v = plist::Dictionary{{"a", plist::Array{1, "b"}}, {"c", plist::Data{std::byte{0x01}, std::byte{0x02}}}};
+
+    for (const auto format : {plist::Format::text, plist::Format::xml, plist::Format::json})
+    {
+        REQUIRE(plist::encode<plist::CompactStyle>(v, format) == plist::encode(v, format, false));
+        REQUIRE(plist::encode<plist::PrettyStyle>(v, format) == plist::encode(v, format, true));
+    }
+
+    using Spaces = plist::Style<true, ' ', 2, plist::LineEnding::crlf>;
+    REQUIRE(plist::encode<Spaces>(v, plist::Format::json) ==
+            "{\r\n  \"a\": [\r\n    1,\r\n    \"b\"\r\n  ],\r\n  \"c\": \"AQI=\"\r\n}");
+    REQUIRE(plist::encode<Spaces>(v, plist::Format::text) ==
+            "// !$*UTF8*$!\r\n{\r\n  a = (\r\n    1,\r\n    b\r\n  );\r\n  c = <01 02>;\r\n}");
+    REQUIRE(plist::encode<plist::Style<false, '\t', 1, plist::LineEnding::crlf>>(v, plist::Format::text) ==
+            "// !$*UTF8*$!\r\n{a=(1,b);c=<0102>;}");
+}
+
+TEST_CASE("Schema validation", "[schema]")
+{
+    plist::Schema setting;
+    setting.type = plist::Type::string;
+    setting.minimum = 1;
+
+    plist::Schema buildSettings;
+    buildSettings.type = plist::Type::dictionary;
+    buildSettings.members.push_back({"SDKROOT", setting, true});
+
+    plist::Schema target;
+    target.type = plist::Type::dictionary;
+    target.additionalMembers = false;
+    target.members.push_back({"name", setting, true});
+    target.members.push_back({"buildSettings", buildSettings, false});
+
+    plist::Schema targets;
+    targets.type = plist::Type::array;
+    targets.minimum = 1;
+    targets.elements = std::make_shared<plist::Schema>(target);
+
+    plist::Schema version;
+    version.type = plist::Type::integer;
+    version.minimum = 1;
+    version.maximum = 3;
+
+    plist::Schema schema;
+    schema.type = plist::Type::dictionary;
+    schema.members.push_back({"version", version, true});
+    schema.members.push_back({"targets", targets, true});
+
+    const plist::Validator validator{schema};
+
+    SECTION("valid")
+    {
+        const plist::Value v = plist::Dictionary{
+            {"version", 2},
+            {"targets", plist::Array{plist::Dictionary{{"name", "app"}, {"buildSettings", plist::Dictionary{{"SDKROOT", "iphoneos"}}}}}},
+            {"comment", "other members are allowed at the top"}
+        };
+        REQUIRE(validator.validate(v).empty());
+    }
+
+    SECTION("violations")
+    {
+        const plist::Value v = plist::Dictionary{
+            {"version", 4},
+            {"targets", plist::Array{
+                plist::Dictionary{{"name", ""}, {"a/b", true}},
+                plist::Dictionary{{"buildSettings", plist::Dictionary{}}},
+                1
+            }}
+        };
+
+        const auto violations = validator.validate(v);
+        std::vector<std::pair<std::string, std::string>> result;
+        for (const auto& violation : violations) result.emplace_back(violation.path, violation.message);
+
+        REQUIRE(result == std::vector<std::pair<std::string, std::string>>{
+            {"/version", "Out of range"},
+            {"/targets/0/name", "Out of range"},
+            {"/targets/0/a~1b", "Unexpected member"},
+            {"/targets/1/buildSettings/SDKROOT", "Missing member"},
+            {"/targets/1/name", "Missing member"},
+            {"/targets/2", "Wrong type"}
+        });
+
+        std::vector<plist::Violation> appended;
+        REQUIRE_FALSE(validator.validate(plist::Value{1}, appended));
+        REQUIRE(appended.size() == 1);
+        REQUIRE(appended[0].path.empty());
+    }
+
+    SECTION("ranges")
+    {
+        plist::Schema positive;
+        positive.minimum = 1;
+        const plist::Validator anyType{positive};
+        REQUIRE(anyType.validate(plist::Value{false}).empty());
+        REQUIRE(anyType.validate(plist::Value{plist::Date{}}).empty());
+        REQUIRE(anyType.validate(plist::Value{"a"}).empty());
+        REQUIRE(anyType.validate(plist::Value{""}).size() == 1);
+        REQUIRE(anyType.validate(plist::Value{0.5}).size() == 1);
+
+        // 2^53 + 1 is not a double, so it must not be rounded down to the bound
+        plist::Schema bounded;
+        bounded.type = plist::Type::integer;
+        bounded.maximum = 9007199254740992.0;
+        const plist::Validator integers{bounded};
+        REQUIRE(integers.validate(plist::Value{std::int64_t{9007199254740992}}).empty());
+        REQUIRE(integers.validate(plist::Value{std::int64_t{9007199254740993}}).size() == 1);
+        REQUIRE(integers.validate(plist::Value{std::numeric_limits<std::int64_t>::min()}).empty());
+
+        bounded.minimum = -0.5;
+        bounded.maximum = 0.5;
+        const plist::Validator fractional{bounded};
+        REQUIRE(fractional.validate(plist::Value{0}).empty());
+        REQUIRE(fractional.validate(plist::Value{1}).size() == 1);
+        REQUIRE(fractional.validate(plist::Value{-1}).size() == 1);
+    }
+
+    SECTION("invalid schema")
+    {
+        plist::Schema duplicate;
+        duplicate.members = {{"a", plist::Schema{}}, {"a", plist::Schema{}}};
+        REQUIRE_THROWS_AS(plist::Validator{duplicate}, std::runtime_error);
+    }
+}
+
+TEST_CASE("Memory usage", "[memory]")
+{
+    const plist::Value shared = plist::Array{std::string(100, 'a'), "b", plist::Data(1000)};
+    const plist::Value v = plist::Dictionary{{"first", shared}, {"second", shared}, {std::string(64, 'k'), 1}};
+
+    const auto usage = plist::memoryUsage(v);
+    REQUIRE(usage.nodes == 7 * sizeof(plist::Value)); // the elements of the shared array are counted once
+    // the capacities and the small buffers of the strings depend on the standard library
+    REQUIRE(usage.strings >= 101);
+    REQUIRE(usage.keys >= 65);
+    REQUIRE(usage.data >= 1000);
+    REQUIRE(usage.containers > 0);
+    REQUIRE(usage.getTotal() == usage.nodes + usage.containers + usage.keys + usage.strings + usage.data);
+
+    REQUIRE(plist::memoryUsage(plist::Value{}).getTotal() == sizeof(plist::Value));
+}
+
+TEST_CASE("Decoding limits", "[json]")
+{
+    const std::string nested = std::string(100, '[') + std::string(100, ']');
+    REQUIRE_NOTHROW(plist::decode(nested, plist::Format::json));
+    REQUIRE_THROWS_AS(plist::decode(std::string(100000, '[') + std::string(100000, ']'), plist::Format::json), plist::ParseError);
+
+    plist::Limits limits;
+    limits.maxDepth = 99;
+    REQUIRE_THROWS_AS(plist::decode(nested, plist::Format::json, limits), plist::ParseError);
+
+    limits = {};
+    limits.maxNodes = 3;
+    REQUIRE_NOTHROW(plist::decode("{\"a\":[1]}", plist::Format::json, limits));
+    REQUIRE_THROWS_AS(plist::decode("{\"a\":[1,2]}", plist::Format::json, limits), plist::ParseError);
+
+    limits = {};
+    limits.maxBytes = 8;
+    REQUIRE_NOTHROW(plist::decode("[1,2,3]", plist::Format::json, limits));
+    REQUIRE_THROWS_AS(plist::decode("[1,2,3,4]", plist::Format::json, limits), plist::ParseError);
+}
+
+TEST_CASE("Dictionary order", "[dictionary]")
+{
+    const plist::Value v = plist::Dictionary{{"b", 1}, {"a", 2}, {"c", plist::Dictionary{{"z", 1}, {"y", 2}}}};
+
+    SECTION("encoding")
+    {
+        REQUIRE(plist::encode(v, plist::Format::json) == "{\"b\":1,\"a\":2,\"c\":{\"z\":1,\"y\":2}}");
+        REQUIRE(plist::encode(v, plist::Format::text) == "// !$*UTF8*$!\n{b=1;a=2;c={z=1;y=2;};}");
+        REQUIRE(plist::encode(plist::decode(plist::encode(v, plist::Format::json), plist::Format::json), plist::Format::json) ==
+                plist::encode(v, plist::Format::json));
+    }
+
+    SECTION("equality")
+    {
+        const plist::Value reordered = plist::Dictionary{{"c", plist::Dictionary{{"y", 2}, {"z", 1}}}, {"a", 2}, {"b", 1}};
+        REQUIRE(v == reordered);
+        REQUIRE(plist::hash(v) == plist::hash(reordered));
+        REQUIRE(plist::diff(v, reordered).empty());
+    }
+
+    SECTION("sorting")
+    {
+        auto sorted = v;
+        plist::sortKeys(sorted);
+        REQUIRE(plist::encode(sorted, plist::Format::json) == "{\"a\":2,\"b\":1,\"c\":{\"y\":2,\"z\":1}}");
+        REQUIRE(plist::encode(v, plist::Format::json) == "{\"b\":1,\"a\":2,\"c\":{\"z\":1,\"y\":2}}");
+    }
+
+    SECTION("sorted key order")
+    {
+        plist::Options options;
+        options.keyOrder = plist::KeyOrder::sorted;
+        REQUIRE(plist::encode(v, plist::Format::json, options) == "{\"a\":2,\"b\":1,\"c\":{\"y\":2,\"z\":1}}");
+        REQUIRE(plist::encode(v, plist::Format::json) == "{\"b\":1,\"a\":2,\"c\":{\"z\":1,\"y\":2}}");
+
+        auto sorted = v;
+        plist::sortKeys(sorted);
+        for (const auto format : {plist::Format::text, plist::Format::xml, plist::Format::binary})
+        {
+            REQUIRE(plist::encode(v, format, options) == plist::encode(sorted, format));
+
+            plist::ChunkedEncoder chunked{v, format, options};
+            std::string result;
+            while (!chunked.isDone()) result += chunked.next(5);
+            REQUIRE(result == plist::encode(sorted, format));
+        }
+    }
+
+    SECTION("frozen")
+    {
+        const auto frozen = plist::freeze(v);
+        REQUIRE(frozen.getRoot()["a"].as<int>() == 2);
+        REQUIRE(frozen.getRoot()["c"]["z"].as<int>() == 1);
+    }
+}
+
+TEST_CASE("Large dictionary", "[dictionary]")
+{
+    plist::Dictionary dictionary;
+    for (int i = 999; i >= 0; --i)
+        dictionary[std::to_string(i)] = i;
+
+    REQUIRE(dictionary.size() == 1000);
+    REQUIRE(dictionary.begin()->first == "999");
+    REQUIRE(dictionary.bucket_count() >= 2000);
+    for (int i = 0; i < 1000; ++i)
+        REQUIRE(dictionary.at(std::to_string(i)).as<int>() == i);
+    REQUIRE(dictionary.find("1000") == dictionary.end());
+
+    REQUIRE_FALSE(dictionary.try_emplace("5", 0).second);
+    REQUIRE(dictionary.insert_or_assign("5", -5).first - dictionary.begin() == 994);
+    REQUIRE(dictionary["5"].as<int>() == -5);
+
+    for (int i = 0; i < 1000; i += 2)
+        REQUIRE(dictionary.erase(std::to_string(i)) == 1);
+    REQUIRE(dictionary.erase("0") == 0);
+    REQUIRE(dictionary.size() == 500);
+    REQUIRE(dictionary.begin()->first == "999");
+    REQUIRE(std::prev(dictionary.end())->first == "1");
+    for (int i = 1; i < 1000; i += 2)
+        REQUIRE(dictionary.at(std::to_string(i)).as<int>() == (i == 5 ? -5 : i));
+    for (int i = 0; i < 1000; i += 2)
+        REQUIRE(dictionary.count(std::to_string(i)) == 0);
+
+    // erasing from the front shifts every position in the index
+    const auto next = dictionary.erase(dictionary.begin());
+    REQUIRE(next->first == "997");
+    REQUIRE(dictionary.count("999") == 0);
+    REQUIRE(dictionary.at("1").as<int>() == 1);
+    dictionary["999"] = 999;
+    REQUIRE(std::prev(dictionary.end())->first == "999");
+
+    for (int i = 999; i > 8; i -= 2)
+        REQUIRE(dictionary.erase(std::to_string(i)) == 1);
+    REQUIRE(dictionary.size() == 4);
+    REQUIRE(dictionary.bucket_count() == 0);
+    REQUIRE(dictionary.at("3").as<int>() == 3);
+    REQUIRE_THROWS_AS(dictionary.at("2"), std::out_of_range);
+}
+
+TEST_CASE("Member references", "[dictionary]")
+{
+    // the right side is evaluated first, so inserting "b" must not move "a"
+    plist::Value v = plist::Dictionary{{"a", std::string(100, 'a')}};
+    v["b"] = v["a"];
+    REQUIRE(v["b"].as<std::string>() == std::string(100, 'a'));
+
+    // also while the index grows and after other members are removed
+    const auto& first = v["a"];
+    for (int i = 0; i < 1000; ++i) v[std::to_string(i)] = v["a"];
+    v.as<plist::Dictionary>().erase("b");
+    v.as<plist::Dictionary>().sort();
+    REQUIRE(&v["a"] == &first);
+    REQUIRE(v["999"].as<std::string>() == std::string(100, 'a'));
+}
+
+TEST_CASE("Merge", "[dictionary]")
+{
+    plist::Value target = plist::Dictionary{
+        {"name", "app"},
+        {"settings", plist::Dictionary{{"a", 1}, {"b", 2}}}
+    };
+
+    SECTION("deep")
+    {
+        plist::Value source = plist::Dictionary{
+            {"settings", plist::Dictionary{{"b", 3}, {"c", 4}}},
+            {"blob", plist::Data(1000)}
+        };
+        const auto bytes = source["blob"].as<plist::Data>().data();
+
+        plist::merge(target, std::move(source));
+        REQUIRE(target == plist::Value{plist::Dictionary{
+            {"name", "app"},
+            {"settings", plist::Dictionary{{"a", 1}, {"b", 3}, {"c", 4}}},
+            {"blob", plist::Data(1000)}
+        }});
+        REQUIRE(target["blob"].as<plist::Data>().data() == bytes); // moved, not copied
+    }
+
+    SECTION("conflicts")
+    {
+        const plist::Value source = plist::Dictionary{{"name", "other"}, {"settings", 5}};
+
+        auto kept = target;
+        plist::merge(kept, source, plist::Conflict::keep);
+        REQUIRE(kept == target);
+
+        auto replaced = target;
+        plist::merge(replaced, source);
+        REQUIRE(replaced == source);
+
+        auto failed = target;
+        REQUIRE_THROWS_AS(plist::merge(failed, source, plist::Conflict::fail), std::runtime_error);
+        REQUIRE(failed == target);
+
+        // the conflict comes after members that could have been merged
+        const plist::Value late = plist::Dictionary{{"extra", 1}, {"settings", plist::Dictionary{{"c", 4}, {"a", 5}}}};
+        REQUIRE_THROWS_AS(plist::merge(failed, late, plist::Conflict::fail), std::runtime_error);
+        REQUIRE(failed == target);
+
+        REQUIRE_NOTHROW(plist::merge(failed, plist::Dictionary{{"new", 1}, {"settings", plist::Dictionary{{"c", 4}}}}, plist::Conflict::fail));
+        REQUIRE(failed["new"].as<int>() == 1);
+        REQUIRE(failed["settings"]["c"].as<int>() == 4);
+    }
+}
+
+TEST_CASE("Bulk insertion", "[dictionary]")
+{
+    std::vector<plist::Dictionary::value_type> members;
+    for (int i = 0; i < 100; ++i) members.emplace_back("key" + std::to_string(i), i);
+    members.emplace_back("key0", -1);
+
+    plist::Dictionary dictionary{{"first", 0}};
+    dictionary.insert(std::make_move_iterator(members.begin()), std::make_move_iterator(members.end()));
+    REQUIRE(dictionary.size() == 101);
+    REQUIRE(dictionary.begin()->first == "first");
+    REQUIRE(dictionary.at("key0").as<int>() == 0);
+    REQUIRE(dictionary.at("key99").as<int>() == 99);
+    REQUIRE(dictionary.bucket_count() >= 2 * dictionary.size());
+
+    const auto hinted = dictionary.emplace_hint(dictionary.end(), "last", 1);
+    REQUIRE(hinted == std::prev(dictionary.end()));
+}
+
+TEST_CASE("Round trip", "[fuzz]")
+{
+    // a short run of the harness in fuzz.cpp, which also checks the throughput
+    roundtrip::Checker checker;
+    for (std::uint32_t seed = 0; seed < 300; ++seed)
+    {
+        INFO("seed " << seed);
+        REQUIRE_NOTHROW(checker.check(roundtrip::generate(seed)));
+    }
+
+    REQUIRE_NOTHROW(checker.checkDecoding("{\"a\": [1, 2.5, \"\\u00e9\\ud83d\\ude00\", true]}"));
+    REQUIRE_NOTHROW(checker.checkDecoding("not json"));
+}
+
+TEST_CASE("Reference encoders", "[fuzz]")
+{
+    REQUIRE(roundtrip::shortestReal(0.1) == "0.1");
+    REQUIRE(roundtrip::shortestReal(1e21) == "1e+21");
+    REQUIRE(roundtrip::shortestReal(-0.0) == "-0");
+    REQUIRE(roundtrip::base64({0x01, 0x02, 0x03, 0x04}) == "AQIDBA==");
+    REQUIRE(roundtrip::isoDate(plist::Date{}) == "1970-01-01T00:00:00Z");
+    REQUIRE(roundtrip::isoDate(plist::Date{std::chrono::hours{-24}}) == "1969-12-31T00:00:00Z");
+
+    const plist::Value v = plist::Dictionary{{"a b", plist::Array{1, true, plist::Data{std::byte{0xAB}}}}};
+    for (const auto format : {plist::Format::text, plist::Format::xml, plist::Format::json})
+        REQUIRE(roundtrip::ReferenceEncoder{format, plist::Options{}}.encode(v) == plist::encode(v, format));
+    REQUIRE(roundtrip::BinaryReader{plist::encode(v, plist::Format::binary)}.read() == v);
+}
+
+TEST_CASE("String encoding throughput", "[!benchmark]")
+{
+    // localization-like mix of ASCII keys and multilingual values, 1 MiB in total
+    std::string text;
+    const char* samples[] = {"Settings", "Einstellungen", "\xE8\xA8\xAD\xE5\xAE\x9A", "\xD0\x9D\xD0\xB0\xD1\x81\xD1\x82\xD1\x80\xD0\xBE\xD0\xB9\xD0\xBA\xD0\xB8", "Param\xC3\xA8tres"};
+    for (std::size_t i = 0; text.size() < 1024 * 1024; ++i)
+        text += samples[i % 5];
+    const plist::Value v = text;
+    const plist::Value ascii = std::string(1024 * 1024, 'a');
+
+    BENCHMARK("binary 1 MiB multilingual") { return plist::encode(v, plist::Format::binary); };
+    BENCHMARK("binary 1 MiB ASCII") { return plist::encode(ascii, plist::Format::binary); };
+    BENCHMARK("xml 1 MiB multilingual") { return plist::encode(v, plist::Format::xml); };
+    BENCHMARK("json 1 MiB multilingual") { return plist::encode(v, plist::Format::json); };
+
+    const auto json = plist::encode(v, plist::Format::json);
+    BENCHMARK("json decoding 1 MiB multilingual") { return plist::decode(json, plist::Format::json); };
+
+    // Catch reports the time per run, the rates of input bytes are printed as well
+    const auto reportRate = [](const char* name, const std::size_t bytes, const auto& function) {
+        using Clock = std::chrono::steady_clock;
+        std::size_t runs = 0;
+        std::size_t outputSize = 0;
+        const auto start = Clock::now();
+        std::chrono::duration<double> elapsed{};
+        do
+        {
+            outputSize += function();
+            ++runs;
+            elapsed = Clock::now() - start;
+        }
+        while (elapsed.count() < 0.5);
+
+        REQUIRE(outputSize >= runs);
+        WARN(name << ": " << static_cast<double>(bytes * runs) / elapsed.count() / 1e9 << " GB/s");
+    };
+
+    reportRate("binary 1 MiB multilingual", text.size(), [&v]() { return plist::encode(v, plist::Format::binary).size(); });
+    reportRate("binary 1 MiB ASCII", std::size_t{1024 * 1024}, [&ascii]() { return plist::encode(ascii, plist::Format::binary).size(); });
+    reportRate("xml 1 MiB multilingual", text.size(), [&v]() { return plist::encode(v, plist::Format::xml).size(); });
+    reportRate("json 1 MiB multilingual", text.size(), [&v]() { return plist::encode(v, plist::Format::json).size(); });
+    reportRate("json decoding 1 MiB multilingual", json.size(), [&json]() {
+        return plist::decode(json, plist::Format::json).as<std::string>().size();
+    });
+}
+
+TEST_CASE("Encoding throughput", "[!benchmark]")
+{
+    plist::Array items;
+    for (int i = 0; i < 20000; ++i)
+        items.push_back(plist::Dictionary{
+            {"enabled", i % 2 == 0},
+            {"index", i},
+            {"name", "item" + std::to_string(i)},
+            {"nested", plist::Dictionary{{"x", 1}, {"y", 2}}},
+            {"tags", plist::Array{"a", "b", "c"}}
+        });
+    const plist::Value v = plist::Dictionary{{"items", items}};
+
+    for (const auto format : {plist::Format::text, plist::Format::xml, plist::Format::json})
+    {
+        const std::string name = format == plist::Format::text ? "text" : format == plist::Format::xml ? "xml" : "json";
+        std::string result;
+
+        // the encoders from before the Style policy write the same bytes
+        std::string before;
+        legacy::encodeInto(before, v, format, plist::Options{});
+        REQUIRE(before == plist::encode<plist::CompactStyle>(v, format));
+
+        BENCHMARK(name + " compact, before")
+        {
+            result.clear();
+            legacy::encodeInto(result, v, format, plist::Options{});
+            return result.size();
+        };
+
+        BENCHMARK(name + " compact")
+        {
+            result.clear();
+            plist::encodeInto<plist::CompactStyle>(result, v, format);
+            return result.size();
+        };
+
+        BENCHMARK(name + " pretty")
+        {
+            result.clear();
+            plist::encodeInto<plist::PrettyStyle>(result, v, format);
+            return result.size();
+        };
+    }
+}
+
+TEST_CASE("Dictionary throughput", "[!benchmark]")
+{
+    std::vector<std::string> keys;
+    for (int i = 0; i < 100000; ++i) keys.push_back("key" + std::to_string(i * 7919 % 100000));
+
+    // the per-key path before the insertion-ordered dictionary, when Dictionary was this std::map
+    BENCHMARK("std::map operator[] 100000")
+    {
+        std::map<std::string, plist::Value> map;
+        for (const auto& key : keys) map[key] = 1;
+        return map.size();
+    };
+
+    BENCHMARK("append 100000 members")
+    {
+        plist::Dictionary dictionary;
+        for (const auto& key : keys) dictionary.try_emplace(key, 1);
+        return dictionary.size();
+    };
+
+    BENCHMARK("Dictionary operator[] 100000")
+    {
+        plist::Value value;
+        for (const auto& key : keys) value[key] = 1;
+        return value.getIf<plist::Dictionary>()->size();
+    };
+
+    std::vector<plist::Dictionary::value_type> members;
+    for (const auto& key : keys) members.emplace_back(key, 1);
+    std::sort(members.begin(), members.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+    BENCHMARK("std::map hinted 100000 sorted")
+    {
+        std::map<std::string, plist::Value> map;
+        for (const auto& member : members) map.emplace_hint(map.end(), member);
+        return map.size();
+    };
+
+    BENCHMARK("bulk insertion 100000 sorted")
+    {
+        plist::Dictionary dictionary;
+        dictionary.insert(members.begin(), members.end());
+        return dictionary.size();
+    };
+
+    BENCHMARK("merge of 100000 members")
+    {
+        plist::Value target = plist::Dictionary{{"existing", 1}};
+        plist::merge(target, plist::Dictionary(members.begin(), members.end()));
+        return target.getIf<plist::Dictionary>()->size();
+    };
+
+    plist::Dictionary dictionary;
+    for (const auto& key : keys) dictionary.try_emplace(key, 1);
+    BENCHMARK("find 100000 members")
+    {
+        std::size_t found = 0;
+        for (const auto& key : keys) found += dictionary.count(key);
+        return found;
+    };
+
+    const plist::Value v = dictionary;
+    std::string result;
+    BENCHMARK("json encoding 100000 members")
+    {
+        result.clear();
+        plist::encodeInto(result, v, plist::Format::json);
+        return result.size();
+    };
+}